@@ -3,17 +3,22 @@
 #include "PortalActor.h"
 #include "PortalActorCharacter.h"
 #include "PortalActorProjectile.h"
+#include "PortalActorProjectilePool.h"
+#include "PortalProjectileBatch.h"
 #include "Animation/AnimInstance.h"
 #include "GameFramework/InputSettings.h"
 #include "Kismet/HeadMountedDisplayFunctionLibrary.h"
 #include "MotionControllerComponent.h"
+#include "PortalCharacterMovementComponent.h"
+#include "PortalTrace.h"
 
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 
 //////////////////////////////////////////////////////////////////////////
 // APortalActorCharacter
 
-APortalActorCharacter::APortalActorCharacter()
+APortalActorCharacter::APortalActorCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.SetDefaultSubobjectClass<UPortalCharacterMovementComponent>(ACharacter::CharacterMovementComponentName))
 {
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(55.f, 96.0f);
@@ -51,6 +56,10 @@ APortalActorCharacter::APortalActorCharacter()
 
 	// Default offset from the character location for projectiles to spawn
 	GunOffset = FVector(100.0f, 0.0f, 10.0f);
+	AimDistance = 10000.0f;
+	ProjectilePoolSize = 32;
+	bBulkProjectiles = false;
+	BulkProjectileMesh = nullptr;
 
 	// Note: The ProjectileClass and the skeletal mesh/anim blueprints for Mesh1P, FP_Gun, and VR_Gun 
 	// are set in the derived blueprint asset named MyCharacter to avoid direct content references in C++.
@@ -99,6 +108,21 @@ void APortalActorCharacter::BeginPlay()
 		VR_Gun->SetHiddenInGame(true, true);
 		Mesh1P->SetHiddenInGame(false, true);
 	}
+
+	// Create the projectiles up front, so the first shots don't spawn them
+	if (ProjectileClass != NULL)
+	{
+		if (bBulkProjectiles)
+		{
+			ProjectileBatch = APortalProjectileBatch::Get(GetWorld(), ProjectileClass);
+			ProjectileBatch->SetMesh(BulkProjectileMesh);
+		}
+		else
+		{
+			ProjectilePool = APortalActorProjectilePool::Get(GetWorld(), ProjectileClass);
+			ProjectilePool->Prewarm(ProjectilePoolSize);
+		}
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -144,20 +168,24 @@ void APortalActorCharacter::OnFire()
 			{
 				const FRotator SpawnRotation = VR_MuzzleLocation->GetComponentRotation();
 				const FVector SpawnLocation = VR_MuzzleLocation->GetComponentLocation();
-				World->SpawnActor<APortalActorProjectile>(ProjectileClass, SpawnLocation, SpawnRotation);
+				FireProjectile(SpawnLocation, SpawnRotation);
 			}
 			else
 			{
-				const FRotator SpawnRotation = GetControlRotation();
+				const FRotator ControlRotation = GetControlRotation();
 				// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
-				const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(GunOffset);
+				const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + ControlRotation.RotateVector(GunOffset);
+
+				// Aim at what the crosshair points at, or at the portal it looks through, rather than straight ahead from the muzzle
+				const FVector CameraLocation = FirstPersonCameraComponent->GetComponentLocation();
+				FCollisionQueryParams AimParams(TEXT("PortalAim"), false, this);
+				FPortalTraceResult AimResult;
+				FPortalTrace::LineTrace(World, CameraLocation, CameraLocation + ControlRotation.Vector() * AimDistance, ECC_Visibility, AimParams, AimResult);
 
-				//Set Spawn Collision Handling Override
-				FActorSpawnParameters ActorSpawnParams;
-				ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+				const FVector AimLocation = AimResult.Segments[0].End;
+				const FRotator SpawnRotation = (AimLocation - SpawnLocation).SizeSquared() > FMath::Square(GunOffset.X) ? (AimLocation - SpawnLocation).Rotation() : ControlRotation;
 
-				// spawn the projectile at the muzzle
-				World->SpawnActor<APortalActorProjectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+				FireProjectile(SpawnLocation, SpawnRotation);
 			}
 		}
 	}
@@ -180,6 +208,28 @@ void APortalActorCharacter::OnFire()
 	}
 }
 
+void APortalActorCharacter::FireProjectile(const FVector& Location, const FRotator& Rotation)
+{
+	// Only looked up again if it was destroyed, or the mode changed since BeginPlay
+	if (bBulkProjectiles)
+	{
+		if (!ProjectileBatch.IsValid())
+		{
+			ProjectileBatch = APortalProjectileBatch::Get(GetWorld(), ProjectileClass);
+		}
+		ProjectileBatch->Fire(Location, Rotation.Vector());
+	}
+	else
+	{
+		if (!ProjectilePool.IsValid())
+		{
+			ProjectilePool = APortalActorProjectilePool::Get(GetWorld(), ProjectileClass);
+		}
+		// fire a pooled projectile from the muzzle, unless it would start inside something
+		ProjectilePool->Acquire(Location, Rotation);
+	}
+}
+
 void APortalActorCharacter::OnResetVR()
 {
 	UHeadMountedDisplayFunctionLibrary::ResetOrientationAndPosition();
@@ -43,7 +43,7 @@ class APortalActorCharacter : public ACharacter
 	class UMotionControllerComponent* L_MotionController;
 
 public:
-	APortalActorCharacter();
+	APortalActorCharacter(const FObjectInitializer& ObjectInitializer);
 
 protected:
 	virtual void BeginPlay();
@@ -61,10 +61,26 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	FVector GunOffset;
 
+	/** How far the crosshair is traced, through portals, to find what projectiles are aimed at */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
+	float AimDistance;
+
 	/** Projectile class to spawn */
 	UPROPERTY(EditDefaultsOnly, Category=Projectile)
 	TSubclassOf<class APortalActorProjectile> ProjectileClass;
 
+	/** Projectiles created up front by the projectile pool, so firing doesn't spawn actors */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	int32 ProjectilePoolSize;
+
+	/** Simulates projectiles in bulk instead of as actors, for large numbers of them */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	bool bBulkProjectiles;
+
+	/** Mesh drawn for each projectile in bulk mode */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	class UStaticMesh* BulkProjectileMesh;
+
 	/** Sound to play each time we fire */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	class USoundBase* FireSound;
@@ -82,6 +98,13 @@ protected:
 	/** Fires a projectile. */
 	void OnFire();
 
+	/** Launches a projectile from the pool, or from the bulk simulation in bulk mode */
+	void FireProjectile(const FVector& Location, const FRotator& Rotation);
+
+	/** Pool and bulk simulation of ProjectileClass, found in BeginPlay rather than on every shot */
+	TWeakObjectPtr<class APortalActorProjectilePool> ProjectilePool;
+	TWeakObjectPtr<class APortalProjectileBatch> ProjectileBatch;
+
 	/** Resets HMD orientation and position in VR. */
 	void OnResetVR();
 
@@ -3,6 +3,8 @@
 #include "PortalActor.h"
 #include "PortalActorProjectile.h"
 #include "GameFramework/ProjectileMovementComponent.h"
+#include "PortalActorProjectilePool.h"
+#include "PortalRegistry.h"
 
 APortalActorProjectile::APortalActorProjectile() 
 {
@@ -31,6 +33,24 @@ APortalActorProjectile::APortalActorProjectile()
 	InitialLifeSpan = 3.0f;
 }
 
+void APortalActorProjectile::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Pooled projectiles only become movers once fired
+	if (!bInPool)
+	{
+		FPortalRegistry::Get(GetWorld()).AddMover(this);
+	}
+}
+
+void APortalActorProjectile::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	FPortalRegistry::Get(GetWorld()).RemoveMover(this);
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void APortalActorProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
 {
 	// Only add impulse and destroy projectile if we hit a physics
@@ -38,6 +58,60 @@ void APortalActorProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherAc
 	{
 		OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
 
+		Recycle();
+	}
+}
+
+void APortalActorProjectile::Fire(const FVector& Location, const FRotator& Rotation)
+{
+	bInPool = false;
+
+	SetActorLocationAndRotation(Location, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+
+	ProjectileMovement->SetUpdatedComponent(CollisionComp);
+	ProjectileMovement->Activate(true);
+	ProjectileMovement->Velocity = Rotation.Vector() * ProjectileMovement->InitialSpeed;
+	ProjectileMovement->UpdateComponentVelocity();
+
+	SetLifeSpan(GetClass()->GetDefaultObject<APortalActorProjectile>()->InitialLifeSpan);
+
+	// Its path starts here, not where it was last deactivated
+	FPortalRegistry::Get(GetWorld()).AddMover(this);
+}
+
+void APortalActorProjectile::Deactivate()
+{
+	bInPool = true;
+
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	SetLifeSpan(0.0f);
+
+	ProjectileMovement->StopMovementImmediately();
+	ProjectileMovement->Deactivate();
+	ProjectileMovement->bAutoActivate = false;
+
+	if (HasActorBegunPlay())
+	{
+		FPortalRegistry::Get(GetWorld()).RemoveMover(this);
+	}
+}
+
+void APortalActorProjectile::Recycle()
+{
+	if (Pool.IsValid())
+	{
+		Pool->Release(this);
+	}
+	else
+	{
 		Destroy();
 	}
+}
+
+void APortalActorProjectile::LifeSpanExpired()
+{
+	Recycle();
 }
\ No newline at end of file
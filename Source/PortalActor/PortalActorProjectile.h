@@ -3,6 +3,8 @@
 #include "GameFramework/Actor.h"
 #include "PortalActorProjectile.generated.h"
 
+class APortalActorProjectilePool;
+
 UCLASS(config=Game)
 class APortalActorProjectile : public AActor
 {
@@ -19,6 +21,22 @@ class APortalActorProjectile : public AActor
 public:
 	APortalActorProjectile();
 
+	/** Registers with the portals of the world, so fast projectiles can't skip over them */
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Starts flying from the location, after being taken from the pool */
+	void Fire(const FVector& Location, const FRotator& Rotation);
+
+	/** Hides and stops the projectile, until it gets fired again */
+	void Deactivate();
+
+	/** Destroys the projectile, or gives it back to its pool */
+	void Recycle();
+
+	void SetPool(APortalActorProjectilePool* InPool) { Pool = InPool; }
+	bool IsInPool() const { return bInPool; }
+
 	/** called when projectile hits something */
 	UFUNCTION()
 	void OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
@@ -27,5 +45,13 @@ public:
 	FORCEINLINE class USphereComponent* GetCollisionComp() const { return CollisionComp; }
 	/** Returns ProjectileMovement subobject **/
 	FORCEINLINE class UProjectileMovementComponent* GetProjectileMovement() const { return ProjectileMovement; }
+
+protected:
+	/** Goes back to the pool instead of being destroyed */
+	virtual void LifeSpanExpired() override;
+
+private:
+	TWeakObjectPtr<APortalActorProjectilePool> Pool;
+	bool bInPool = false;
 };
 
@@ -0,0 +1,120 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Components/SphereComponent.h"
+#include "PortalActorProjectile.h"
+#include "PortalManager.h"
+#include "PortalActorProjectilePool.h"
+
+APortalActorProjectilePool* APortalActorProjectilePool::Get(UWorld* World, TSubclassOf<APortalActorProjectile> ProjectileClass)
+{
+	for (TActorIterator<APortalActorProjectilePool> It(World); It; ++It)
+	{
+		if (!It->IsPendingKill() && It->ProjectileClass == ProjectileClass)
+		{
+			return *It;
+		}
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.ObjectFlags |= RF_Transient;
+
+	APortalActorProjectilePool* Pool = World->SpawnActor<APortalActorProjectilePool>(SpawnParameters);
+	Pool->ProjectileClass = ProjectileClass;
+	return Pool;
+}
+
+void APortalActorProjectilePool::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Get rather than Find, portals may begin play after the pool
+	Manager = APortalManager::Get(GetWorld());
+}
+
+void APortalActorProjectilePool::Prewarm(int32 Count)
+{
+	while (Projectiles.Num() < Count)
+	{
+		APortalActorProjectile* Projectile = SpawnProjectile();
+		if (!Projectile)
+		{
+			return;
+		}
+		FreeProjectiles.Push(Projectile);
+	}
+}
+
+APortalActorProjectile* APortalActorProjectilePool::Acquire(const FVector& Location, const FRotator& Rotation)
+{
+	APortalActorProjectile* Projectile = nullptr;
+	while (!Projectile && FreeProjectiles.Num() > 0)
+	{
+		Projectile = FreeProjectiles.Pop(false);
+
+		// Projectiles may still be destroyed from the outside, e.g. by killing the actors of the level
+		if (Projectile && Projectile->IsPendingKill())
+		{
+			Projectiles.RemoveSwap(Projectile);
+			Projectile = nullptr;
+		}
+	}
+
+	if (!Projectile)
+	{
+		Projectile = SpawnProjectile();
+		if (!Projectile)
+		{
+			return nullptr;
+		}
+	}
+
+	// Same as spawning with DontSpawnIfColliding. Pooled projectiles have their collision disabled, which FindTeleportSpot
+	// would take as never encroaching, so the sphere is tested explicitly
+	USphereComponent* CollisionComp = Projectile->GetCollisionComp();
+	FCollisionQueryParams Params(FName("PortalProjectilePool"), false, Projectile);
+	if (GetWorld()->OverlapBlockingTestByProfile(Location, Rotation.Quaternion(), CollisionComp->GetCollisionProfileName(), CollisionComp->GetCollisionShape(), Params))
+	{
+		FreeProjectiles.Push(Projectile);
+		return nullptr;
+	}
+
+	// Portals may still hold the cooldown of the projectile's previous flight
+	if (Manager.IsValid())
+	{
+		Manager->ClearCooldowns(Projectile);
+	}
+
+	Projectile->Fire(Location, Rotation);
+	return Projectile;
+}
+
+void APortalActorProjectilePool::Release(APortalActorProjectile* Projectile)
+{
+	if (!Projectile->IsInPool())
+	{
+		Projectile->Deactivate();
+		FreeProjectiles.Push(Projectile);
+	}
+}
+
+APortalActorProjectile* APortalActorProjectilePool::SpawnProjectile()
+{
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParameters.bDeferConstruction = true;
+
+	// Spawned inactive, it starts flying once acquired
+	APortalActorProjectile* Projectile = GetWorld()->SpawnActor<APortalActorProjectile>(ProjectileClass, GetActorTransform(), SpawnParameters);
+	if (!Projectile)
+	{
+		return nullptr;
+	}
+
+	Projectile->SetPool(this);
+	Projectile->Deactivate();
+	Projectile->FinishSpawning(GetActorTransform());
+
+	Projectiles.Add(Projectile);
+	return Projectile;
+}
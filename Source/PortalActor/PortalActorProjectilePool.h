@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+#include "GameFramework/Actor.h"
+#include "PortalActorProjectilePool.generated.h"
+
+class APortalActorProjectile;
+class APortalManager;
+
+/**
+ * Keeps projectiles of one class around instead of spawning and destroying one per shot.
+ * Released projectiles are hidden, stopped and stop colliding, and get fired again from there.
+ */
+UCLASS(NotPlaceable, Transient)
+class APortalActorProjectilePool : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	/** Pool of the world for the projectile class, spawned on first use */
+	static APortalActorProjectilePool* Get(UWorld* World, TSubclassOf<APortalActorProjectile> ProjectileClass);
+
+	/** Makes sure at least Count projectiles exist, so the first shots don't pay for spawning them */
+	void Prewarm(int32 Count);
+
+	/** Fires a projectile from the location, or returns null when it would start inside blocking geometry */
+	APortalActorProjectile* Acquire(const FVector& Location, const FRotator& Rotation);
+
+	/** Takes a projectile back, called instead of destroying it */
+	void Release(APortalActorProjectile* Projectile);
+
+	int32 GetNumFree() const { return FreeProjectiles.Num(); }
+	int32 GetNumProjectiles() const { return Projectiles.Num(); }
+
+protected:
+	virtual void BeginPlay() override;
+
+private:
+	APortalActorProjectile* SpawnProjectile();
+
+	UPROPERTY()
+	TSubclassOf<APortalActorProjectile> ProjectileClass;
+
+	/** Every projectile of the pool, in flight or not */
+	UPROPERTY()
+	TArray<APortalActorProjectile*> Projectiles;
+
+	UPROPERTY()
+	TArray<APortalActorProjectile*> FreeProjectiles;
+
+	/** Found once instead of on every shot */
+	TWeakObjectPtr<APortalManager> Manager;
+};
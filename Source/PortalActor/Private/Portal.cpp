@@ -5,14 +5,25 @@
 #include "Engine/TextureRenderTarget2D.h"
 #include "DrawDebugHelpers.h"
 #include "Components/ArrowComponent.h"
-#include "EngineUtils.h"
+#include "AI/Navigation/NavigationSystem.h"
+#include "AI/Navigation/NavLinkCustomComponent.h"
+#include "GameFramework/MovementComponent.h"
+#include "PortalMath.h"
+#include "PortalCharacterMovementComponent.h"
+#include "PortalCaptureScheduler.h"
+#include "PortalGraph.h"
+#include "PortalManager.h"
+#include "PortalProxyRenderer.h"
+#include "PortalRegistry.h"
+#include "PortalRenderTargetPool.h"
+#include "PortalStats.h"
 #include "Portal.h"
 
 
 // Sets default values
 APortal::APortal() {
-	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// All portals of the world are updated together by the portal manager
+	PrimaryActorTick.bCanEverTick = false;
 
 	Frame = CreateDefaultSubobject<UStaticMeshComponent>(FName("Frame"));
 	RootComponent = Frame;
@@ -21,16 +32,28 @@ APortal::APortal() {
 	Portal = CreateDefaultSubobject<UStaticMeshComponent>(FName("Portal"));
 	Portal->AttachToComponent(RootComponent, FAttachmentTransformRules(EAttachmentRule::KeepRelative, true));
 
-	TargetCapture = CreateDefaultSubobject<USceneCaptureComponent2D>(FName("TargetCapture"));
-	TargetCapture->AttachToComponent(RootComponent, FAttachmentTransformRules(EAttachmentRule::KeepWorld, true));
-
-	TeleportedActors = TSet<AActor*>();
-	ReceivedActors = TSet<AActor*>();
+	// Dedicated servers only teleport, they never create captures, render targets or materials
+	if (!IsRunningDedicatedServer()) {
+		// Captures are rendered on demand by the capture scheduler
+		TargetCapture = CreateDefaultSubobject<USceneCaptureComponent2D>(FName("TargetCapture"));
+		TargetCapture->bCaptureEveryFrame = false;
+		TargetCapture->bCaptureOnMovement = false;
+		TargetCapture->AttachToComponent(RootComponent, FAttachmentTransformRules(EAttachmentRule::KeepWorld, true));
+	}
 
 	Overlap = CreateDefaultSubobject<UBoxComponent>(FName("Overlap"));
 	Overlap->AttachToComponent(RootComponent, FAttachmentTransformRules(EAttachmentRule::KeepRelative, true));
 	Overlap->bGenerateOverlapEvents = true;
 	Overlap->SetCollisionProfileName(FName("Portal"));
+
+	// Set up once the portal has a Target, see UpdateNavLink
+	NavLink = CreateDefaultSubobject<UNavLinkCustomComponent>(FName("NavLink"));
+	NavLink->SetEnabled(false);
+
+	// Only used for teleport events, every client needs them for the actors it sees going through
+	bReplicates = true;
+	bAlwaysRelevant = true;
+	NetUpdateFrequency = 1.0f;
 }
 
 // Called when the game starts or when spawned
@@ -39,56 +62,325 @@ void APortal::BeginPlay() {
 
 	Overlap->OnComponentBeginOverlap.AddDynamic(this, &APortal::OnOverlapBegin);
 
-	if (!Target) {
+	FPortalRegistry::Get(GetWorld()).Register(this);
+	APortalManager::Get(GetWorld())->Register(this);
+	FPortalGraph::Get(GetWorld()).Add(this);
+	RootComponent->TransformUpdated.AddUObject(this, &APortal::OnPortalMoved);
+
+	// Nothing to draw the proxies for on dedicated servers
+	if (TargetCapture) {
+		APortalProxyRenderer::Get(GetWorld())->Register(this);
+	}
+
+	if (!Target || !TargetCapture) {
 		return;
 	}
 
 	TargetCapture->SetWorldLocation(Target->GetActorLocation());
 
 	if (ensure(PortalMaterial)) {
-		Portal->SetMaterial(0, MakeRenderMaterial(TargetCapture));
+		MainSlot.Capture = TargetCapture;
+		MainSlot.Mesh = Portal;
+		MainSlot.Material = MakeRenderMaterial();
+		MainSlot.HiddenSet = MakeShareable(new FPortalHiddenSet(TargetCapture));
+		Portal->SetMaterial(0, MainSlot.Material);
+
+		UTexture* RightTarget = nullptr;
+		bStereoMaterial = PortalMaterial->GetTextureParameterValue(FName("TargetRight"), RightTarget);
+	}
+}
+
+void APortal::EndPlay(const EEndPlayReason::Type EndPlayReason) {
+	RootComponent->TransformUpdated.RemoveAll(this);
+	FPortalRegistry::Get(GetWorld()).Unregister(this);
+	FPortalGraph::Get(GetWorld()).Remove(this);
 
+	auto Manager = APortalManager::Find(GetWorld());
+	if (Manager) {
+		Manager->Unregister(this);
 	}
+
+	auto ProxyRenderer = APortalProxyRenderer::Find(GetWorld());
+	if (ProxyRenderer) {
+		ProxyRenderer->Unregister(this);
+	}
+
+	ReleaseRenderTarget(MainSlot);
+	for (auto& PlayerSlot : PlayerSlots) {
+		ReleaseRenderTarget(PlayerSlot);
+	}
+	for (auto& RequesterSlot : RequesterSlots) {
+		ReleaseRenderTarget(RequesterSlot.Value);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void APortal::OnPortalMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport) {
+	// Invalidates the cached transforms of this portal and of the portals leading here
+	TransformVersion += 1;
+
+	FPortalRegistry::Get(GetWorld()).Update(this);
+	FPortalGraph::Get(GetWorld()).Invalidate(this);
+}
+
+UMaterialInstanceDynamic* APortal::MakeRenderMaterial() {
+	return UMaterialInstanceDynamic::Create(PortalMaterial, this);
+}
+
+float APortal::GetTierScale(int32 Tier) const {
+	return 1.0f / (float)(1 << Tier);
+}
+
+int32 APortal::SelectResolutionTier(int32 CurrentTier, float ResolutionScale) const {
+	// Smallest tier still covering the portal on screen
+	int32 Tier = 0;
+	while (Tier < MaxResolutionTier && GetTierScale(Tier + 1) >= ResolutionScale) {
+		Tier += 1;
+	}
+
+	// Only drop resolution once the portal is clearly smaller than the lower tier, so it doesn't thrash at the boundary
+	while (Tier > CurrentTier && ResolutionScale > GetTierScale(Tier) * (1.0f - ResolutionHysteresis)) {
+		Tier -= 1;
+	}
+
+	return Tier;
+}
+
+USceneCaptureComponent2D* APortal::CreateCapture() {
+	auto Capture = NewObject<USceneCaptureComponent2D>(this);
+	Capture->bCaptureEveryFrame = false;
+	Capture->bCaptureOnMovement = false;
+	Capture->RegisterComponent();
+	Capture->AttachToComponent(RootComponent, FAttachmentTransformRules(EAttachmentRule::KeepWorld, true));
+
+	return Capture;
+}
+
+// Capture, material and mesh of a slot, for captures other than the Portal mesh's own
+void APortal::CreateCaptureSlot(FPortalCaptureSlot& Slot) {
+	Slot.Capture = CreateCapture();
+
+	Slot.Material = MakeRenderMaterial();
+	Slot.HiddenSet = MakeShareable(new FPortalHiddenSet(Slot.Capture));
+
+	Slot.Mesh = NewObject<UStaticMeshComponent>(this);
+	Slot.Mesh->RegisterComponent();
+	Slot.Mesh->AttachToComponent(RootComponent, FAttachmentTransformRules(EAttachmentRule::KeepRelative, true));
+	Slot.Mesh->SetStaticMesh(Portal->GetStaticMesh());
+	Slot.Mesh->SetRelativeTransform(Portal->GetRelativeTransform());
+	Slot.Mesh->SetMaterial(0, Slot.Material);
+	Slot.Mesh->SetHiddenInGame(false);
+	Slot.Mesh->SetVisibility(true);
 }
 
-UMaterialInstanceDynamic* APortal::MakeRenderMaterial(USceneCaptureComponent2D* CaptureToUse) {
-	FVector2D ViewportSize;
-	GetWorld()->GetGameViewport()->GetViewportSize(ViewportSize);
+// ResolutionScale is the fraction of the player's view size the capture needs to cover its portal on screen
+void APortal::UseCaptureSlot(FPortalCaptureSlot& Slot, float ResolutionScale, const FIntPoint& ViewSize, bool bStereo) {
+	Slot.LastUsedFrame = GFrameCounter;
 
-	UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>(this);
-	RenderTarget->InitAutoFormat(ViewportSize.X, ViewportSize.Y);
-	RenderTarget->UpdateResourceImmediate(true);
+	if (Slot.bStereo != bStereo) {
+		SetSlotStereo(Slot, bStereo);
+	}
 
-	CaptureToUse->TextureTarget = RenderTarget;
+	int32 Tier = SelectResolutionTier(Slot.ResolutionTier, ResolutionScale);
+	if (Tier != Slot.ResolutionTier) {
+		ReleaseRenderTarget(Slot);
+		Slot.ResolutionTier = Tier;
+	}
 
-	UMaterialInstanceDynamic* PortalMaterialInstance = UMaterialInstanceDynamic::Create(PortalMaterial, this);
-	PortalMaterialInstance->SetTextureParameterValue(FName("Target"), RenderTarget);
+	FIntPoint CaptureSize = ViewSize / (1 << Slot.ResolutionTier);
+	CaptureSize = FIntPoint(FMath::Max(CaptureSize.X, 1), FMath::Max(CaptureSize.Y, 1));
 
-	return PortalMaterialInstance;
+	// Splitscreen layouts change when players join or leave
+	if (Slot.RenderTarget && (Slot.RenderTarget->SizeX != CaptureSize.X || Slot.RenderTarget->SizeY != CaptureSize.Y)) {
+		ReleaseRenderTarget(Slot);
+	}
+
+	if (Slot.RenderTarget) {
+		return;
+	}
+
+	Slot.RenderTarget = FPortalRenderTargetPool::Get().Acquire(CaptureSize.X, CaptureSize.Y);
+	Slot.Capture->TextureTarget = Slot.RenderTarget;
+	Slot.Material->SetTextureParameterValue(FName("Target"), Slot.RenderTarget);
+	Slot.bNeedsCapture = true;
+
+	if (Slot.bStereo) {
+		Slot.RightRenderTarget = FPortalRenderTargetPool::Get().Acquire(CaptureSize.X, CaptureSize.Y);
+		Slot.RightCapture->TextureTarget = Slot.RightRenderTarget;
+		Slot.Material->SetTextureParameterValue(FName("TargetRight"), Slot.RightRenderTarget);
+	}
 }
 
-// Called every frame
-void APortal::Tick(float DeltaTime) {
-	Super::Tick(DeltaTime);
+// The portal material shows Target to the left eye and TargetRight to the right one while Stereo is set
+void APortal::SetSlotStereo(FPortalCaptureSlot& Slot, bool bStereo) {
+	ReleaseRenderTarget(Slot);
+	Slot.bStereo = bStereo;
 
-	if (!TargetCapture) {
+	if (bStereo && !Slot.RightCapture) {
+		Slot.RightCapture = CreateCapture();
+		Slot.RightCapture->FOVAngle = Slot.Capture->FOVAngle;
+		Slot.RightCapture->CaptureSource = Slot.Capture->CaptureSource;
+		Slot.RightHiddenSet = MakeShareable(new FPortalHiddenSet(Slot.RightCapture));
+	}
+
+	Slot.Material->SetScalarParameterValue(FName("Stereo"), bStereo ? 1.0f : 0.0f);
+}
+
+void APortal::ReleaseRenderTarget(FPortalCaptureSlot& Slot) {
+	if (!Slot.RenderTarget) {
 		return;
 	}
 
-	UpdateCapture();
+	// The target may be handed to another portal, so make sure nothing keeps drawing into or from it
+	Slot.Capture->TextureTarget = nullptr;
+	Slot.Material->SetTextureParameterValue(FName("Target"), nullptr);
+
+	FPortalRenderTargetPool::Get().Release(Slot.RenderTarget);
+	Slot.RenderTarget = nullptr;
+
+	if (Slot.RightRenderTarget) {
+		Slot.RightCapture->TextureTarget = nullptr;
+		Slot.Material->SetTextureParameterValue(FName("TargetRight"), nullptr);
+
+		FPortalRenderTargetPool::Get().Release(Slot.RightRenderTarget);
+		Slot.RightRenderTarget = nullptr;
+	}
+}
+
+void APortal::ReleaseIdleRenderTargets() {
+	uint64 IdleFrame = GFrameCounter - IdleFramesBeforeRelease;
+
+	if (MainSlot.LastUsedFrame < IdleFrame) {
+		ReleaseRenderTarget(MainSlot);
+	}
+
+	for (auto& PlayerSlot : PlayerSlots) {
+		if (PlayerSlot.LastUsedFrame < IdleFrame) {
+			ReleaseRenderTarget(PlayerSlot);
+		}
+	}
+
+	for (auto& RequesterSlot : RequesterSlots) {
+		if (RequesterSlot.Value.LastUsedFrame < IdleFrame) {
+			ReleaseRenderTarget(RequesterSlot.Value);
+		}
+	}
+}
+
+void APortal::EvictRequesterSlots() {
+	while (RequesterSlots.Num() > MaxRequesterSlots) {
+		uint32 OldestID = 0;
+		uint64 OldestFrame = GFrameCounter;
+		for (auto& RequesterSlot : RequesterSlots) {
+			if (RequesterSlot.Value.LastUsedFrame < OldestFrame) {
+				OldestID = RequesterSlot.Key;
+				OldestFrame = RequesterSlot.Value.LastUsedFrame;
+			}
+		}
+
+		// Everything left is in use this frame, it will be reconsidered on the next one
+		if (OldestFrame == GFrameCounter) {
+			return;
+		}
+
+		FPortalCaptureSlot Slot;
+		RequesterSlots.RemoveAndCopyValue(OldestID, Slot);
+
+		if (bDebug) {
+			UE_LOG(LogPortal, Log, TEXT("Evict %s capture for requester %u"), *GetName(), OldestID);
+		}
+
+		ReleaseRenderTarget(Slot);
+		Slot.Capture->DestroyComponent();
+		Slot.Mesh->DestroyComponent();
+	}
+}
+
+void APortal::SweepCooldowns(float CurrentTime) {
+	TeleportedActors.Sweep(CurrentTime);
+	ReceivedActors.Sweep(CurrentTime);
+}
+
+APortal* APortal::GetTarget() const {
+	return Target;
+}
+
+void APortal::SetTarget(APortal* NewTarget) {
+	if (Target == NewTarget) {
+		return;
+	}
+
+	Target = NewTarget;
+
+	if (HasActorBegunPlay()) {
+		FPortalGraph::Get(GetWorld()).Invalidate(this);
+	}
+}
+
+FVector APortal::GetEntryLocation() const {
+	FVector Extent = Overlap->GetScaledBoxExtent();
+	return Overlap->GetComponentLocation() + GetActorForwardVector() * (Extent.X + NavLinkOffset) - GetActorUpVector() * Extent.Z;
+}
+
+FVector APortal::GetExitLocation() const {
+	if (!Target) {
+		return GetEntryLocation();
+	}
+
+	return GetTeleportTransform(FTransform(GetEntryLocation())).GetLocation();
+}
+
+void APortal::UpdateNavLink() {
+	uint32 TargetVersion = Target ? Target->TransformVersion : 0;
+	if (NavLinkTarget == Target && NavLinkSourceVersion == TransformVersion && NavLinkTargetVersion == TargetVersion) {
+		return;
+	}
+
+	NavLinkTarget = Target;
+	NavLinkSourceVersion = TransformVersion;
+	NavLinkTargetVersion = TargetVersion;
+
+	// Link points are relative to the portal, so the exit is brought into its space
+	FTransform ActorTransform = GetActorTransform();
+	FVector Start = ActorTransform.InverseTransformPosition(GetEntryLocation());
+	FVector End = ActorTransform.InverseTransformPosition(GetExitLocation());
+
+	NavLink->SetLinkData(Start, End, ENavLinkDirection::LeftToRight);
+	NavLink->SetEnabled(Target != nullptr);
+	UNavigationSystem::UpdateComponentInNavOctree(*NavLink);
 }
 
 USceneCaptureComponent2D* APortal::GetCaptureComponent() const {
 	return TargetCapture;
 }
 
-TArray<UPrimitiveComponent*> APortal::GetPortalComponents(const APortal* Requester) const {
-	TArray<UPrimitiveComponent*> HiddenPortalComponents;
-	PortalMeshesMap.GenerateValueArray(HiddenPortalComponents);
+USceneCaptureComponent2D* APortal::GetRightCaptureComponent() const {
+	return MainSlot.RightCapture;
+}
 
-	HiddenPortalComponents.AddUnique(Portal);
+bool APortal::SupportsStereo() const {
+	return bStereoMaterial;
+}
 
-	return HiddenPortalComponents;
+FBox APortal::GetPortalBounds() const {
+	return Portal->Bounds.GetBox();
+}
+
+void APortal::HidePortalComponents(FPortalHiddenSet& HiddenSet, const UPrimitiveComponent* VisibleMesh) const {
+	for (auto& PlayerSlot : PlayerSlots) {
+		HiddenSet.Hide(PlayerSlot.Mesh);
+	}
+
+	for (auto& RequesterSlot : RequesterSlots) {
+		if (RequesterSlot.Value.Mesh != VisibleMesh) {
+			HiddenSet.Hide(RequesterSlot.Value.Mesh);
+		}
+	}
+
+	if (Portal != VisibleMesh) {
+		HiddenSet.Hide(Portal);
+	}
 }
 
 bool APortal::CheckNeedToUpdate(FVector ActorLocation) const {
@@ -103,44 +395,281 @@ bool APortal::CheckNeedToUpdate(FVector ActorLocation) const {
 	return false;
 }
 
+// Visibility is traced asynchronously: the trace issued this frame runs after the game thread tick,
+// and its result is picked up the next frame. Until a first result arrives the portal counts as in sight
+bool APortal::IsPortalInSight(const USceneCaptureComponent2D* Capture, const APortal* VisiblePortal) const {
+	uint64 Key = ((uint64)Capture->GetUniqueID() << 32) | VisiblePortal->GetUniqueID();
+	FPortalSightTrace& Trace = SightTraces.FindOrAdd(Key);
+	Trace.RequestedFrame = GFrameCounter;
+
+	// Kept up to date by UpdateSightTraces from then on, whether the capture is due or not
+	if (!Trace.Capture.IsValid()) {
+		Trace.Capture = Capture;
+		Trace.VisiblePortal = VisiblePortal;
+		IssueSightTrace(Trace);
+	}
+
+	return !Trace.bHasResult || Trace.bInSight;
+}
+
+void APortal::IssueSightTrace(FPortalSightTrace& Trace) const {
+	Trace.Handle = GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, Trace.Capture->GetComponentLocation(), Trace.VisiblePortal->GetActorLocation(), ECollisionChannel::ECC_Camera);
+	Trace.IssuedFrame = GFrameCounter;
+	PORTAL_INC_COUNTER(Traces, 1);
+}
+
+void APortal::UpdateSightTraces() {
+	// Captures which are not due keep their traces going for a while, as they are likely to look again soon
+	const uint64 MaxIdleFrames = 30;
+
+	for (auto It = SightTraces.CreateIterator(); It; ++It) {
+		FPortalSightTrace& Trace = It.Value();
+		if (GFrameCounter - Trace.RequestedFrame > MaxIdleFrames || !Trace.Capture.IsValid() || !Trace.VisiblePortal.IsValid()) {
+			It.RemoveCurrent();
+			continue;
+		}
+
+		// Issued earlier this frame
+		if (Trace.IssuedFrame == GFrameCounter) {
+			continue;
+		}
+
+		// Results are only available the frame after the trace was issued, which is why this runs every frame
+		FTraceDatum TraceDatum;
+		if (Trace.Handle.IsValid() && GetWorld()->QueryTraceData(Trace.Handle, TraceDatum)) {
+			Trace.bHasResult = true;
+			Trace.bInSight = TraceDatum.OutHits.Num() > 0;
+		}
+
+		IssueSightTrace(Trace);
+	}
+}
+
+float APortal::GetLastRenderTime() const {
+	float LastRenderTime = Portal->LastRenderTime;
+	for (const FPortalCaptureSlot& PlayerSlot : PlayerSlots) {
+		LastRenderTime = FMath::Max(LastRenderTime, PlayerSlot.Mesh->LastRenderTime);
+	}
+
+	return LastRenderTime;
+}
+
+bool APortal::IsCaptureActive() const {
+	if (!Target || !MainSlot.Capture) {
+		return false;
+	}
+
+	// Portals occluded last frame are very likely still occluded, skip them until the renderer sees them again
+	return GetWorld()->TimeSince(GetLastRenderTime()) <= OcclusionTolerance;
+}
+
 // Big thanks to Redbox for this algorithm:
 // https://wiki.unrealengine.com/Simple_Portals
-// TODO: fix method for viewing portal through portal
+// PlayerViews are filled in beforehand by the portal manager
 void APortal::UpdateCapture() {
-	if (!Target) {
+	if (PlayerViews.Num() == 0) {
 		return;
 	}
 
-	auto PlayerCamera = GetWorld()->GetFirstPlayerController()->PlayerCameraManager;
-	auto CameraLocation = PlayerCamera->GetCameraLocation();
+	PORTAL_SCOPE_CYCLE_COUNTER(UpdateCapture);
+	PORTAL_SCOPED_TIMING(UpdateCapture);
 
-	if (!CheckNeedToUpdate(CameraLocation)) {
+	FPortalCaptureScheduler::FScopedWork ScopedWork;
+
+	int32 NumGroups = GroupPlayerViews();
+	UpdatePlayerVisibility(NumGroups);
+
+	for (int32 Group = 0; Group < NumGroups; Group++) {
+		CaptureForGroup(Group);
+	}
+}
+
+bool APortal::CanShareCapture(const FPortalPlayerView& Leader, const FPortalPlayerView& View) const {
+	if (Leader.ViewSize != View.ViewSize || Leader.bStereo != View.bStereo) {
+		return false;
+	}
+
+	if (FVector::DistSquared(Leader.CaptureTransform.GetLocation(), View.CaptureTransform.GetLocation()) > FMath::Square(SharedCaptureDistance)) {
+		return false;
+	}
+
+	return Leader.CaptureTransform.GetRotation().AngularDistance(View.CaptureTransform.GetRotation()) <= FMath::DegreesToRadians(SharedCaptureAngle);
+}
+
+// Returns the number of groups, every player view is assigned to one
+int32 APortal::GroupPlayerViews() {
+	int32 NumGroups = 0;
+	for (int32 Index = 0; Index < PlayerViews.Num(); Index++) {
+		FPortalPlayerView& View = PlayerViews[Index];
+
+		for (int32 LeaderIndex = 0; LeaderIndex < Index; LeaderIndex++) {
+			const FPortalPlayerView& Leader = PlayerViews[LeaderIndex];
+			if (Leader.bLeader && CanShareCapture(Leader, View)) {
+				View.Group = Leader.Group;
+				break;
+			}
+		}
+
+		if (View.Group == INDEX_NONE) {
+			View.Group = NumGroups++;
+			View.bLeader = true;
+		}
+	}
+
+	// Groups past the first need captures and meshes of their own
+	while (PlayerSlots.Num() < NumGroups - 1) {
+		int32 Index = PlayerSlots.AddDefaulted();
+		CreateCaptureSlot(PlayerSlots[Index]);
+	}
+
+	return NumGroups;
+}
+
+FPortalCaptureSlot& APortal::GetGroupSlot(int32 Group) {
+	return Group == 0 ? MainSlot : PlayerSlots[Group - 1];
+}
+
+// Each local player only sees the mesh showing its own group's capture
+void APortal::UpdatePlayerVisibility(int32 NumGroups) {
+	// Never went past a single group, nothing is hidden from anyone
+	if (PlayerSlots.Num() == 0) {
 		return;
 	}
 
-	auto CaptureTransform = GetTeleportTransform(PlayerCamera->GetTransformComponent()->GetComponentTransform(), true);
+	for (int32 Index = 0; Index < PlayerSlots.Num(); Index++) {
+		PlayerSlots[Index].Mesh->SetHiddenInGame(Index + 1 >= NumGroups);
+	}
 
-	TargetCapture->SetWorldLocationAndRotation(CaptureTransform.GetLocation(), CaptureTransform.GetRotation());
+	for (auto It = GetWorld()->GetPlayerControllerIterator(); It; ++It) {
+		APlayerController* PlayerController = It->Get();
+		if (!PlayerController || !PlayerController->IsLocalController()) {
+			continue;
+		}
 
-	Target->UpdatePortalsInSight(this);
+		// Players not looking at the portal see the main mesh
+		int32 PlayerGroup = 0;
+		for (const FPortalPlayerView& View : PlayerViews) {
+			if (View.PlayerController == PlayerController) {
+				PlayerGroup = View.Group;
+				break;
+			}
+		}
 
-	// set clip plane
-	// !!! This requires to enable global clip option in the project's settings
-	TargetCapture->ClipPlaneNormal = Target->GetActorForwardVector();
-	TargetCapture->ClipPlaneBase = Target->GetActorLocation();
-	TargetCapture->bEnableClipPlane = true;
+		auto& HiddenComponents = PlayerController->HiddenPrimitiveComponents;
+		for (int32 Group = 0; Group < NumGroups; Group++) {
+			UPrimitiveComponent* Mesh = GetGroupSlot(Group).Mesh;
+			int32 HiddenIndex = HiddenComponents.IndexOfByKey(Mesh);
 
+			if (Group == PlayerGroup && HiddenIndex != INDEX_NONE) {
+				HiddenComponents.RemoveAtSwap(HiddenIndex, 1, false);
+			} else if (Group != PlayerGroup && HiddenIndex == INDEX_NONE) {
+				HiddenComponents.Add(Mesh);
+			}
+		}
+	}
 }
 
-void APortal::UpdatePortalsInSight(const APortal* Requester) const {
-	auto RequesterCapture = Requester->GetCaptureComponent();
-	RequesterCapture->HiddenComponents.Empty();
+void APortal::CaptureForGroup(int32 Group) {
+	FPortalCaptureSlot& Slot = GetGroupSlot(Group);
 
-	uint32 SkippedComponents = 0;
-	for (TActorIterator<APortal> ActorItr(GetWorld()); ActorItr; ++ActorItr) {
-		APortal* VisiblePortal = *ActorItr;
+	// The group's capture has to cover the portal for whichever of its players sees it biggest and closest
+	const FPortalPlayerView* Leader = nullptr;
+	float ResolutionScale = 0.0f;
+	float Distance = MAX_FLT;
+	for (const FPortalPlayerView& View : PlayerViews) {
+		if (View.Group != Group) {
+			continue;
+		}
+
+		if (View.bLeader) {
+			Leader = &View;
+		}
+		ResolutionScale = FMath::Max(ResolutionScale, View.ResolutionScale);
+		Distance = FMath::Min(Distance, View.Distance);
+	}
+
+	// A material without TargetRight would show the left eye's image to both eyes, capture once from between them instead
+	UseCaptureSlot(Slot, ResolutionScale, Leader->ViewSize, Leader->bStereo && SupportsStereo());
 
-		if (VisiblePortal == Requester) {
+	// Small and distant portals are refreshed every few frames and keep their last image in between.
+	// Both eyes follow the schedule of the left one, so they never show images from different frames
+	if (!Slot.bNeedsCapture && !FPortalCaptureScheduler::Get().IsCaptureDue(Slot.Capture, ResolutionScale, Distance)) {
+		return;
+	}
+
+	// The scheduler never drops captures into new render targets, so the slot is done with them once requested
+	bool bRequired = Slot.bNeedsCapture;
+	Slot.bNeedsCapture = false;
+
+	float TierScale = GetTierScale(Slot.ResolutionTier);
+	if (Slot.bStereo) {
+		CaptureForView(Slot.Capture, Slot.HiddenSet.Get(), Leader->LeftCaptureTransform, TierScale, Leader->ViewSize, bRequired);
+		CaptureForView(Slot.RightCapture, Slot.RightHiddenSet.Get(), Leader->RightCaptureTransform, TierScale, Leader->ViewSize, bRequired);
+	} else {
+		CaptureForView(Slot.Capture, Slot.HiddenSet.Get(), Leader->CaptureTransform, TierScale, Leader->ViewSize, bRequired);
+	}
+}
+
+void APortal::CaptureForView(USceneCaptureComponent2D* Capture, FPortalHiddenSet* HiddenSet, const FTransform& CaptureTransform, float ResolutionScale, const FIntPoint& ViewSize, bool bRequired) {
+	Capture->SetWorldLocationAndRotation(CaptureTransform.GetLocation(), CaptureTransform.GetRotation());
+	SetupCaptureClipping(Capture);
+
+	FPortalView View = { this, Capture, HiddenSet, ResolutionScale, ViewSize, 0 };
+	Target->UpdatePortalsInSight(View);
+
+	FPortalCaptureScheduler::Get().RequestCapture(Capture, View.Depth, bRequired);
+}
+
+// Hides everything between the capture and the Target portal, which would otherwise block the view through it
+void APortal::SetupCaptureClipping(USceneCaptureComponent2D* Capture) const {
+	FVector ClipNormal = Target->GetActorForwardVector();
+	FVector ClipBase = Target->GetActorLocation();
+
+	if (ClipMode == EPortalClipMode::GlobalClipPlane) {
+		// !!! This requires to enable global clip option in the project's settings
+		Capture->ClipPlaneNormal = ClipNormal;
+		Capture->ClipPlaneBase = ClipBase;
+		Capture->bEnableClipPlane = true;
+		Capture->bUseCustomProjectionMatrix = false;
+		return;
+	}
+
+	FMatrix ViewMatrix = FPortalMath::MakeViewMatrix(Capture->GetComponentLocation(), Capture->GetComponentRotation());
+	FMatrix ProjectionMatrix = FPortalMath::MakeProjectionMatrix(Capture->FOVAngle, FPortalMath::GetCaptureAspectRatio(Capture));
+
+	Capture->CustomProjectionMatrix = FPortalMath::MakeObliqueProjectionMatrix(ProjectionMatrix, ViewMatrix, FPlane(ClipBase, ClipNormal));
+	Capture->bUseCustomProjectionMatrix = true;
+	Capture->bEnableClipPlane = false;
+}
+
+void APortal::UpdatePortalsInSight(const FPortalView& View) const {
+	PORTAL_SCOPE_CYCLE_COUNTER(UpdatePortalsInSight);
+	PORTAL_SCOPED_TIMING(UpdatePortalsInSight);
+
+	auto RequesterCapture = View.Capture;
+	View.HiddenSet->BeginUpdate();
+
+	// Only portals inside the capture frustum and in front of this portal can be seen through it.
+	// Without a far plane that makes five planes, which fit in the volume's inline storage
+	FConvexVolume SightVolume = FPortalMath::MakeCaptureFrustum(RequesterCapture);
+	SightVolume.Planes.Add(FPlane(GetActorLocation(), -GetActorForwardVector()));
+	SightVolume.Init();
+
+	// The frustum has no far plane, past the furthest portal there is nothing to find anyway
+	const FPortalRegistry& Registry = FPortalRegistry::Get(GetWorld());
+	float FarDistance = Registry.GetMaxDistance(RequesterCapture->GetComponentLocation());
+	FBox SightBounds = FPortalMath::MakeCaptureFrustumBounds(RequesterCapture, FarDistance);
+
+	// Kept per depth, as rendering a seen portal can come back here for a deeper view before this loop is done
+	while (SightCandidates.Num() <= View.Depth) {
+		SightCandidates.Add(new TArray<APortal*>());
+	}
+	TArray<APortal*>& CandidatePortals = SightCandidates[View.Depth];
+	CandidatePortals.Reset();
+	Registry.QueryVolume(SightVolume, SightBounds, CandidatePortals);
+
+	for (APortal* VisiblePortal : CandidatePortals) {
+		if (VisiblePortal == View.Portal) {
 			continue;
 		}
 
@@ -150,75 +679,77 @@ void APortal::UpdatePortalsInSight(const APortal* Requester) const {
 			continue;
 		}
 
-		FHitResult HitResult;
-		FVector CaptureLocation = RequesterCapture->GetComponentLocation();
-		if (!GetWorld()->LineTraceSingleByChannel(HitResult, CaptureLocation, PortalLocation, ECollisionChannel::ECC_Camera)) {
+		if (!IsPortalInSight(RequesterCapture, VisiblePortal)) {
 			continue;
 		}
 
-		auto VisiblePortalMesh = VisiblePortal->RenderForPortal(Requester);
+		auto VisiblePortalMesh = VisiblePortal->RenderForPortal(View);
+		VisiblePortal->HidePortalComponents(*View.HiddenSet, VisiblePortalMesh);
+	}
 
-		auto HiddenPortalComponents = VisiblePortal->GetPortalComponents(Requester);
-		for (UPrimitiveComponent* HiddenPortalComponent : HiddenPortalComponents) {
-			if (HiddenPortalComponent->GetUniqueID() == VisiblePortalMesh->GetUniqueID()) {
-				SkippedComponents += 1;
-				if (Requester->bDebug) {
-					UE_LOG(LogTemp, Warning, TEXT("skipped: %s / %s"), *VisiblePortal->GetName(), *HiddenPortalComponent->GetName());
-				}
-				continue;
-			}
+	View.HiddenSet->EndUpdate();
 
-			RequesterCapture->HiddenComponents.AddUnique(HiddenPortalComponent);
-		}
+	PORTAL_INC_COUNTER(HiddenComponents, View.HiddenSet->Num());
+
+	if (View.Portal->bDebug) {
+		UE_LOG(LogPortal, Verbose, TEXT("Hidden components: %d, depth: %d"), View.HiddenSet->Num(), View.Depth);
 	}
+}
+
+UStaticMeshComponent* APortal::RenderForPortal(const FPortalView& RequesterView) {
+	PORTAL_SCOPE_CYCLE_COUNTER(RenderForPortal);
+	PORTAL_SCOPED_TIMING(RenderForPortal);
 
-	if (Requester->bDebug) {
-		UE_LOG(LogTemp, Warning, TEXT("Hidden components: %d, skipped: %d"), RequesterCapture->HiddenComponents.Num(), SkippedComponents);
+	if (RequesterView.Portal->bDebug) {
+		UE_LOG(LogPortal, Verbose, TEXT("Render %s for %s at depth %d"), *GetName(), *RequesterView.Portal->GetName(), RequesterView.Depth + 1);
 	}
 
-}
+	uint32 RequesterID = RequesterView.Capture->GetUniqueID();
+	FPortalCaptureSlot* Slot = RequesterSlots.Find(RequesterID);
+
+	// Past the recursion limit or the frame budget, keep showing what was last rendered for this requester
+	if (!Target || !FPortalCaptureScheduler::Get().CanRecurse(RequesterView.Depth)) {
+		if (!Slot) {
+			return Portal;
+		}
 
-UStaticMeshComponent* APortal::RenderForPortal(const APortal* Requester) {
-	if (!Requester) {
-		return nullptr;
+		Slot->LastUsedFrame = GFrameCounter;
+		return Slot->Mesh;
 	}
 
-	if (Requester->bDebug) {
-		UE_LOG(LogTemp, Warning, TEXT("Render %s for %s"), *GetName(), *Requester->GetName());
+	if (!Slot) {
+		Slot = &RequesterSlots.Add(RequesterID);
+		CreateCaptureSlot(*Slot);
 	}
 
-	USceneCaptureComponent2D* PortalCapture;
-	UStaticMeshComponent* PortalMesh;
+	// The requester's image is already scaled down, this portal only needs to match its share of it
+	float ScreenCoverage = FPortalMath::GetScreenCoverage(GetPortalBounds(), FPortalMath::MakeCaptureViewProjection(RequesterView.Capture));
+	float ResolutionScale = FMath::Sqrt(ScreenCoverage) * RequesterView.ResolutionScale;
+	UseCaptureSlot(*Slot, ResolutionScale, RequesterView.ViewSize);
 
-	uint32 RequesterID = Requester->GetUniqueID();
-	if (CapturesMap.Contains(RequesterID)) {
-		PortalCapture = CapturesMap[RequesterID];
-		PortalMesh = Cast<UStaticMeshComponent>(PortalMeshesMap[RequesterID]);
-	} else {
-		PortalCapture = NewObject<USceneCaptureComponent2D>(this);
-		PortalCapture->RegisterComponent();
-		PortalCapture->AttachToComponent(RootComponent, FAttachmentTransformRules(EAttachmentRule::KeepWorld, true));
-		CapturesMap.Add(RequesterID, PortalCapture);
-
-		PortalMesh = NewObject<UStaticMeshComponent>(this);
-		PortalMesh->RegisterComponent();
-		PortalMesh->AttachToComponent(RootComponent, FAttachmentTransformRules(EAttachmentRule::KeepRelative, true));
-		PortalMesh->SetStaticMesh(Portal->GetStaticMesh());
-		PortalMesh->SetRelativeTransform(Portal->GetRelativeTransform());
-		PortalMesh->SetMaterial(0, MakeRenderMaterial(PortalCapture));
-		//PortalMesh->SetMaterial(0, Portal->GetMaterial(0));
-		PortalMesh->SetHiddenInGame(false);
-		PortalMesh->SetVisibility(true);
-		
-		PortalMeshesMap.Add(RequesterID, PortalMesh);
-	}
-
-	auto CaptureTransform = GetTeleportTransform(Requester->GetCaptureComponent()->GetComponentTransform(), true);
+	// Distance from the requester's virtual viewpoint, which is what the player perceives through the portal
+	float Distance = FVector::Dist(RequesterView.Capture->GetComponentLocation(), GetActorLocation());
+	if (!Slot->bNeedsCapture && !FPortalCaptureScheduler::Get().IsCaptureDue(Slot->Capture, ResolutionScale, Distance)) {
+		return Slot->Mesh;
+	}
+
+	// Same as for the player captures, a new render target is captured regardless of the budget
+	bool bRequired = Slot->bNeedsCapture;
+	Slot->bNeedsCapture = false;
+
+	// The slot may move in memory once the nested views below add slots of their own
+	USceneCaptureComponent2D* PortalCapture = Slot->Capture;
+	UStaticMeshComponent* PortalMesh = Slot->Mesh;
+	FPortalView View = { this, PortalCapture, Slot->HiddenSet.Get(), GetTierScale(Slot->ResolutionTier), RequesterView.ViewSize, RequesterView.Depth + 1 };
+
+	auto CaptureTransform = GetTeleportTransform(RequesterView.Capture->GetComponentTransform(), true);
 
 	PortalCapture->SetWorldLocationAndRotation(CaptureTransform.GetLocation(), CaptureTransform.GetRotation());
-	PortalCapture->ClipPlaneNormal = Target->GetActorForwardVector();
-	PortalCapture->ClipPlaneBase = Target->GetActorLocation();
-	PortalCapture->bEnableClipPlane = true;
+	SetupCaptureClipping(PortalCapture);
+
+	Target->UpdatePortalsInSight(View);
+
+	FPortalCaptureScheduler::Get().RequestCapture(PortalCapture, View.Depth, bRequired);
 
 	return PortalMesh;
 }
@@ -229,47 +760,80 @@ void APortal::OnOverlapBegin(UPrimitiveComponent* OverlappedComponent, AActor* O
 	}
 
 	// Temporary add the Actor to a list, to avoid duplicate teleports (becaue of multiple BeginOverlap events)
-	SetCleanupTimer(OtherActor, &TeleportedActors);
+	TeleportedActors.Add(OtherActor, GetWorld()->GetTimeSeconds() + TeleportCooldown);
 
 	// TODO: disable teleporting when overlapping from behind
 	Teleport(OtherActor);
 }
 
-FTransform APortal::GetTeleportTransform(FTransform ActorTransform, bool bCaptureTransform) const {
+FTransform APortal::GetTeleportTransform(const FTransform& ActorTransform, bool bCaptureTransform) const {
+	FTransform Result;
+	TransformThroughPortal(GetPairTransform(), &ActorTransform, &Result, 1, bCaptureTransform);
+
+	return Result;
+}
+
+void APortal::GetTeleportTransforms(const TArray<FTransform>& ActorTransforms, TArray<FTransform>& OutTransforms, bool bCaptureTransform) const {
+	OutTransforms.SetNumUninitialized(ActorTransforms.Num(), false);
+	TransformThroughPortal(GetPairTransform(), ActorTransforms.GetData(), OutTransforms.GetData(), ActorTransforms.Num(), bCaptureTransform);
+}
+
+FVector APortal::GetTeleportDirection(const FVector& Direction) const {
+	return GetPairTransform().Rotation.RotateVector(Direction);
+}
+
+const FPortalPairTransform& APortal::GetPairTransform() const {
+	if (PairTransform.Target == Target && PairTransform.SourceVersion == TransformVersion && PairTransform.TargetVersion == Target->TransformVersion) {
+		return PairTransform;
+	}
+
 	FTransform SourceTransform = GetActorTransform();
 	FTransform TargetTransform = Target->GetActorTransform();
 
+	// Going through the portal mirrors both X and Y in portal space, in other words turns around Z
+	FMatrix DirectionMatrix = SourceTransform.ToInverseMatrixWithScale() * FScaleMatrix(FVector(-1, -1, 1)) * TargetTransform.ToMatrixWithScale();
+
+	// Views come out mirrored the same way as directions, teleported actors keep their side along X
 	FVector SourceScale = SourceTransform.GetScale3D();
-	// TODO: fix it for bCaptureTransform == false (teleportation)
-	FVector InverseScale = FVector(SourceScale.X * bCaptureTransform ? -1 : 1, SourceScale.Y * -1, SourceScale.Z);
-	FTransform InverseTransform = FTransform(SourceTransform.Rotator(), SourceTransform.GetLocation(), InverseScale);
+	FTransform InverseTransform = FTransform(SourceTransform.Rotator(), SourceTransform.GetLocation(), FVector(SourceScale.X, -SourceScale.Y, SourceScale.Z));
 
-	FVector CaptureLocation = TargetTransform.TransformPosition(InverseTransform.InverseTransformPosition(ActorTransform.GetLocation()));
+	// Also maps the source location onto the target location, so it serves views as is
+	PairTransform.CaptureMatrix = DirectionMatrix;
+	PairTransform.TeleportMatrix = InverseTransform.ToInverseMatrixWithScale() * TargetTransform.ToMatrixWithScale();
+	PairTransform.Rotation = FRotationMatrix::MakeFromXY(DirectionMatrix.GetScaledAxis(EAxis::X), DirectionMatrix.GetScaledAxis(EAxis::Y)).ToQuat();
 
-	FRotationMatrix R = FRotationMatrix(ActorTransform.Rotator());
-	FVector OUT_X;
-	FVector OUT_Y;
-	FVector OUT_Z;
-	R.GetScaledAxes(OUT_X, OUT_Y, OUT_Z);
+	PairTransform.Target = Target;
+	PairTransform.SourceVersion = TransformVersion;
+	PairTransform.TargetVersion = Target->TransformVersion;
 
-	auto SourceByX = FMath::GetReflectionVector(SourceTransform.InverseTransformVector(OUT_Y), FVector(1, 0, 0));
+	return PairTransform;
+}
+
+void APortal::TransformThroughPortal(const FPortalPairTransform& Pair, const FTransform* ActorTransforms, FTransform* OutTransforms, int32 Num, bool bCaptureTransform) {
+	const FMatrix& PositionMatrix = bCaptureTransform ? Pair.CaptureMatrix : Pair.TeleportMatrix;
+	VectorRegister PairRotation = VectorLoadAligned(&Pair.Rotation);
 
-	auto SourceByXY = FMath::GetReflectionVector(SourceByX, FVector(0, 1, 0));
-	auto DirectionY = TargetTransform.TransformVector(SourceByXY);
+	for (int32 Index = 0; Index < Num; Index++) {
+		const FTransform& ActorTransform = ActorTransforms[Index];
 
-	auto TargetByX = FMath::GetReflectionVector(SourceTransform.InverseTransformVector(OUT_X), FVector(1, 0, 0));
+		FVector ActorLocation = ActorTransform.GetLocation();
+		FQuat ActorRotation = ActorTransform.GetRotation();
 
-	auto TargetByXY = FMath::GetReflectionVector(TargetByX, FVector(0, 1, 0));
-	auto DirectionX = TargetTransform.TransformVector(TargetByXY);
+		VectorRegister Location = VectorTransformVector(VectorLoadFloat3_W1(&ActorLocation), &PositionMatrix);
+		VectorRegister Rotation = VectorQuaternionMultiply2(PairRotation, VectorLoadAligned(&ActorRotation));
 
-	auto CaptureRotation = FRotationMatrix::MakeFromXY(DirectionX, DirectionY).Rotator();
+		FVector OutLocation;
+		FQuat OutRotation;
+		VectorStoreFloat3(Location, &OutLocation);
+		VectorStoreAligned(Rotation, &OutRotation);
 
-	return FTransform(CaptureRotation, CaptureLocation);
+		OutTransforms[Index] = FTransform(OutRotation, OutLocation);
+	}
 }
 
 void APortal::Teleport(AActor* Actor) {
 	// Don't teleport the Portal itself suddenly
-	if (Actor == this) {
+	if (Actor == this || !ShouldTeleportLocally(Actor)) {
 		return;
 	}
 
@@ -279,26 +843,134 @@ void APortal::Teleport(AActor* Actor) {
 	}
 
 	Target->TeleportReceived(Actor);
-	auto Transform = GetTeleportTransform(Actor->GetActorTransform());
+	MoveThroughPortal(Actor, GetTeleportTransform(Actor->GetActorTransform()));
+}
+
+bool APortal::IntersectSegment(const FVector& Start, const FVector& End, float& OutTime) const {
+	return GetOpening().IntersectSegment(Start, End, OutTime);
+}
+
+FPortalOpening APortal::GetOpening() const {
+	// The overlap box outlines the opening of the portal
+	FTransform OverlapTransform = Overlap->GetComponentTransform();
+	FVector OpeningExtent = Overlap->GetScaledBoxExtent();
+
+	FPortalOpening Opening;
+	Opening.Location = GetActorLocation();
+	Opening.Normal = GetActorForwardVector();
+	Opening.Center = OverlapTransform.GetLocation();
+	Opening.AxisY = OverlapTransform.GetUnitAxis(EAxis::Y);
+	Opening.AxisZ = OverlapTransform.GetUnitAxis(EAxis::Z);
+	Opening.Extent = FVector2D(OpeningExtent.Y, OpeningExtent.Z);
+
+	return Opening;
+}
+
+void APortal::GetStraddlingActors(TArray<AActor*>& OutActors) const {
+	Overlap->GetOverlappingActors(OutActors);
+	OutActors.RemoveAll([this](AActor* Actor) {
+		return Actor == this;
+	});
+}
+
+bool FPortalOpening::IntersectSegment(const FVector& Start, const FVector& End, float& OutTime) const {
+	float StartDistance = FVector::DotProduct(Start - Location, Normal);
+	float EndDistance = FVector::DotProduct(End - Location, Normal);
+
+	// Only going in through the front counts
+	if (StartDistance <= 0 || EndDistance > 0) {
+		return false;
+	}
+
+	float Time = StartDistance / (StartDistance - EndDistance);
+
+	FVector Crossing = FMath::Lerp(Start, End, Time) - Center;
+	if (FMath::Abs(FVector::DotProduct(Crossing, AxisY)) > Extent.X || FMath::Abs(FVector::DotProduct(Crossing, AxisZ)) > Extent.Y) {
+		return false;
+	}
+
+	OutTime = Time;
+	return true;
+}
+
+void APortal::TeleportAtCrossing(AActor* Actor, const FVector& CrossingLocation) {
+	if (Actor == this || !Target || !ShouldTeleportLocally(Actor)) {
+		return;
+	}
+
+	if (TeleportedActors.Contains(Actor) || ReceivedActors.Contains(Actor)) {
+		return;
+	}
+
+	TeleportedActors.Add(Actor, GetWorld()->GetTimeSeconds() + TeleportCooldown);
+	Target->TeleportReceived(Actor);
+
+	// Come out of the Target where the actor went in, then carry on for whatever distance it travelled past the portal
+	auto Transform = GetTeleportTransform(FTransform(Actor->GetActorQuat(), CrossingLocation));
+	Transform.AddToTranslation(GetPairTransform().Rotation.RotateVector(Actor->GetActorLocation() - CrossingLocation));
+
+	MoveThroughPortal(Actor, Transform);
+}
+
+void APortal::MoveThroughPortal(AActor* Actor, const FTransform& Transform) {
+	PORTAL_SCOPE_CYCLE_COUNTER(Teleport);
+	PORTAL_SCOPED_TIMING(Teleport);
+	PORTAL_INC_COUNTER(Teleports, 1);
+
 	Actor->SetActorLocation(Transform.GetLocation());
 
+	// Pawns of other players have no controller on clients
 	auto PawnActor = Cast<APawn>(Actor);
-	if (IsValid(PawnActor)) {
+	if (IsValid(PawnActor) && PawnActor->GetController()) {
 		auto Controller = PawnActor->GetController();
 		Controller->SetControlRotation(Transform.Rotator());
 	} else {
 		Actor->SetActorRotation(Transform.GetRotation());
 	}
+
+	// Keep the momentum heading out of the Target
+	auto Movement = Actor->FindComponentByClass<UMovementComponent>();
+	if (Movement) {
+		Movement->Velocity = GetPairTransform().Rotation.RotateVector(Movement->Velocity);
+	}
+
+	FPortalRegistry::Get(GetWorld()).ResetMover(Actor);
+
+	auto PortalMovement = Actor->FindComponentByClass<UPortalCharacterMovementComponent>();
+	if (PortalMovement) {
+		PortalMovement->NotifyTeleport(this);
+	}
+
+	if (HasAuthority() && GetNetMode() != NM_Standalone && Actor->GetIsReplicated()) {
+		MulticastTeleport(Actor, Target->GetActorTransform().InverseTransformPosition(Transform.GetLocation()));
+	}
 }
 
-void APortal::TeleportReceived(AActor* ReceivedActor) {
-	SetCleanupTimer(ReceivedActor, &ReceivedActors);
+// Clients leave replicated actors to the server, except their own pawn which they predict
+bool APortal::ShouldTeleportLocally(const AActor* Actor) const {
+	return !Actor->GetIsReplicated() || Actor->Role == ROLE_Authority || Actor->Role == ROLE_AutonomousProxy;
 }
 
-void APortal::SetCleanupTimer(AActor* ActorToCleanup, TSet<AActor*>* ActorsList) {
-	ActorsList->Add(ActorToCleanup);
-	FTimerHandle CleanupTimer;
-	GetWorld()->GetTimerManager().SetTimer(CleanupTimer, [=]() {
-		ActorsList->Remove(ActorToCleanup);
-	}, 0.1f, false);
+void APortal::MulticastTeleport_Implementation(AActor* Actor, FVector_NetQuantize10 TargetOffset) {
+	if (!Actor || !Target || HasAuthority()) {
+		return;
+	}
+
+	// The owning client already went through on its own
+	auto PortalMovement = Actor->FindComponentByClass<UPortalCharacterMovementComponent>();
+	if (PortalMovement && PortalMovement->HasRecentTeleport(this)) {
+		return;
+	}
+
+	TeleportedActors.Add(Actor, GetWorld()->GetTimeSeconds() + TeleportCooldown);
+	Target->TeleportReceived(Actor);
+
+	auto Transform = GetTeleportTransform(Actor->GetActorTransform());
+	Transform.SetLocation(Target->GetActorTransform().TransformPosition(TargetOffset));
+
+	MoveThroughPortal(Actor, Transform);
+}
+
+void APortal::TeleportReceived(AActor* ReceivedActor) {
+	ReceivedActors.Add(ReceivedActor, GetWorld()->GetTimeSeconds() + TeleportCooldown);
 }
@@ -0,0 +1,171 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "PortalStats.h"
+#include "PortalCaptureScheduler.h"
+
+
+static TAutoConsoleVariable<int32> CVarPortalMaxRecursionDepth(
+	TEXT("portal.MaxRecursionDepth"),
+	2,
+	TEXT("How many portals deep a portal can be seen through other portals. 0 disables portal-in-portal rendering."));
+
+static TAutoConsoleVariable<int32> CVarPortalCaptureBudget(
+	TEXT("portal.CaptureBudget"),
+	16,
+	TEXT("Maximum number of portal scene captures rendered per frame. 0 means no limit."));
+
+static TAutoConsoleVariable<float> CVarPortalCaptureBudgetMs(
+	TEXT("portal.CaptureBudgetMs"),
+	2.0f,
+	TEXT("Game thread milliseconds per frame after which portals stop descending into portal-in-portal views. 0 means no limit."));
+
+static TAutoConsoleVariable<float> CVarPortalNearCaptureDistance(
+	TEXT("portal.NearCaptureDistance"),
+	1000.0f,
+	TEXT("Portals closer than this to the viewer are captured every frame regardless of their size on screen."));
+
+static TAutoConsoleVariable<int32> CVarPortalMaxUpdateInterval(
+	TEXT("portal.MaxUpdateInterval"),
+	8,
+	TEXT("Most frames apart a portal capture may be rendered. 1 captures every portal every frame."));
+
+FPortalCaptureScheduler& FPortalCaptureScheduler::Get() {
+	static FPortalCaptureScheduler Scheduler;
+	return Scheduler;
+}
+
+FPortalCaptureScheduler::FPortalCaptureScheduler() {
+	FWorldDelegates::OnWorldPostActorTick.AddRaw(this, &FPortalCaptureScheduler::Flush);
+}
+
+bool FPortalCaptureScheduler::CanRecurse(int32 Depth) const {
+	if (Depth >= CVarPortalMaxRecursionDepth.GetValueOnGameThread()) {
+		return false;
+	}
+
+	float BudgetMs = CVarPortalCaptureBudgetMs.GetValueOnGameThread();
+	if (BudgetMs > 0.0f && Frame == GFrameCounter && GetWorkSeconds() * 1000.0 > BudgetMs) {
+		return false;
+	}
+
+	return true;
+}
+
+int32 FPortalCaptureScheduler::GetUpdateInterval(float ScreenScale, float Distance) const {
+	if (Distance < CVarPortalNearCaptureDistance.GetValueOnGameThread()) {
+		return 1;
+	}
+
+	// Halve the rate every time the portal halves in size on screen, starting below half the screen
+	int32 MaxInterval = FMath::Max(CVarPortalMaxUpdateInterval.GetValueOnGameThread(), 1);
+	int32 Interval = 1;
+	while (Interval < MaxInterval && ScreenScale < 0.5f / Interval) {
+		Interval *= 2;
+	}
+
+	return FMath::Min(Interval, MaxInterval);
+}
+
+bool FPortalCaptureScheduler::IsCaptureDue(const USceneCaptureComponent2D* Capture, float ScreenScale, float Distance) const {
+	uint32 Interval = GetUpdateInterval(ScreenScale, Distance);
+
+	// Captures are created one after another, so their IDs spread them evenly over the frames of an interval
+	bool bDue = (GFrameCounter + Capture->GetUniqueID()) % Interval == 0;
+	if (!bDue) {
+		PORTAL_INC_COUNTER(CapturesNotDue, 1);
+	}
+
+	return bDue;
+}
+
+int32 FPortalCaptureScheduler::GetCapturesThisFrame() const {
+	return Frame == GFrameCounter ? CapturesThisFrame : 0;
+}
+
+void FPortalCaptureScheduler::RequestCapture(USceneCaptureComponent2D* Capture, int32 Depth, bool bRequired) {
+	BeginFrame();
+
+	Requests.Add({ Capture, Depth, Frame, bRequired });
+}
+
+FPortalCaptureScheduler::FScopedWork::FScopedWork() {
+	auto& Scheduler = FPortalCaptureScheduler::Get();
+	Scheduler.BeginFrame();
+	Scheduler.WorkStartTime = FPlatformTime::Seconds();
+}
+
+FPortalCaptureScheduler::FScopedWork::~FScopedWork() {
+	auto& Scheduler = FPortalCaptureScheduler::Get();
+	Scheduler.WorkSeconds += FPlatformTime::Seconds() - Scheduler.WorkStartTime;
+	Scheduler.WorkStartTime = 0.0;
+}
+
+void FPortalCaptureScheduler::BeginFrame() {
+	if (Frame == GFrameCounter) {
+		return;
+	}
+
+	Frame = GFrameCounter;
+	CapturesThisFrame = 0;
+	WorkSeconds = 0.0;
+}
+
+double FPortalCaptureScheduler::GetWorkSeconds() const {
+	if (WorkStartTime > 0.0) {
+		return WorkSeconds + FPlatformTime::Seconds() - WorkStartTime;
+	}
+
+	return WorkSeconds;
+}
+
+void FPortalCaptureScheduler::Flush(UWorld* World, ELevelTick TickType, float DeltaSeconds) {
+	if (Requests.Num() == 0) {
+		return;
+	}
+
+	PORTAL_SCOPE_CYCLE_COUNTER(FlushCaptures);
+
+	BeginFrame();
+
+	// Shallow captures are what the player sees directly, they get the budget first
+	Requests.StableSort([](const FRequest& A, const FRequest& B) {
+		return A.Depth < B.Depth;
+	});
+
+	int32 Budget = CVarPortalCaptureBudget.GetValueOnGameThread();
+
+	Accepted.Reset();
+
+	int32 NumKept = 0;
+	for (const FRequest& Request : Requests) {
+		USceneCaptureComponent2D* Capture = Request.Capture.Get();
+
+		// Drop requests of destroyed captures, or of worlds which did not tick in their frame
+		if (!Capture || Request.Frame != Frame) {
+			continue;
+		}
+
+		// Other worlds flush their own requests once they have ticked
+		if (Capture->GetWorld() != World) {
+			Requests[NumKept++] = Request;
+			continue;
+		}
+
+		if (Request.bRequired || Budget <= 0 || CapturesThisFrame < Budget) {
+			Accepted.Add(Request);
+			CapturesThisFrame += 1;
+		} else {
+			PORTAL_INC_COUNTER(CapturesOverBudget, 1);
+		}
+	}
+	Requests.SetNum(NumKept, false);
+
+	// Deepest first, so outer captures see this frame's image of the portals inside them
+	for (int32 Index = Accepted.Num() - 1; Index >= 0; Index--) {
+		Accepted[Index].Capture->CaptureSceneDeferred();
+	}
+
+	PORTAL_INC_COUNTER(CapturesRendered, Accepted.Num());
+}
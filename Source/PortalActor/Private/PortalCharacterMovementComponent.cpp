@@ -0,0 +1,162 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Portal.h"
+#include "PortalRegistry.h"
+#include "PortalStats.h"
+#include "PortalCharacterMovementComponent.h"
+
+
+void UPortalCharacterMovementComponent::NotifyTeleport(const APortal* Portal) {
+	LastTeleportPortal = Portal;
+	LastTeleportTime = GetWorld()->GetTimeSeconds();
+	NumTeleports += 1;
+
+	// Only the owning client keeps moves to replay, the server and the other clients only follow
+	if (Portal && Portal->GetTarget() && CharacterOwner && CharacterOwner->Role == ROLE_AutonomousProxy && HasPredictionData_Client()) {
+		TransformSavedMoves(Portal);
+		bTeleportedThisMove = true;
+	}
+}
+
+// The moves before the teleport are replayed from where the character came out when the server corrects one of them
+void UPortalCharacterMovementComponent::TransformSavedMoves(const APortal* Portal) {
+	auto ClientData = GetPredictionData_Client_Character();
+
+	auto TransformMove = [Portal](FSavedMove_Character& Move) {
+		FTransform Start = Portal->GetTeleportTransform(FTransform(Move.StartRotation, Move.StartLocation));
+		FTransform Saved = Portal->GetTeleportTransform(FTransform(Move.SavedRotation, Move.SavedLocation));
+
+		Move.StartLocation = Start.GetLocation();
+		Move.StartRotation = Start.Rotator();
+		Move.SavedLocation = Saved.GetLocation();
+		Move.SavedRotation = Saved.Rotator();
+		Move.StartControlRotation = Portal->GetTeleportTransform(FTransform(Move.StartControlRotation)).Rotator();
+		Move.SavedControlRotation = Portal->GetTeleportTransform(FTransform(Move.SavedControlRotation)).Rotator();
+
+		Move.StartVelocity = Portal->GetTeleportDirection(Move.StartVelocity);
+		Move.SavedVelocity = Portal->GetTeleportDirection(Move.SavedVelocity);
+		Move.Acceleration = Portal->GetTeleportDirection(Move.Acceleration);
+	};
+
+	// The pending move is normally one of the saved moves too, it must not go through twice
+	for (const FSavedMovePtr& Move : ClientData->SavedMoves) {
+		TransformMove(*Move);
+	}
+	if (ClientData->PendingMove.IsValid() && !ClientData->SavedMoves.Contains(ClientData->PendingMove)) {
+		TransformMove(*ClientData->PendingMove);
+	}
+}
+
+void UPortalCharacterMovementComponent::ReplicateMoveToServer(float DeltaTime, const FVector& NewAcceleration) {
+	bTeleportedThisMove = false;
+
+	Super::ReplicateMoveToServer(DeltaTime, NewAcceleration);
+
+	// Combining moves puts the character back where the first one started, on the other side for the move that crossed
+	if (bTeleportedThisMove && HasPredictionData_Client()) {
+		auto ClientData = GetPredictionData_Client_Character();
+		if (ClientData->SavedMoves.Num() > 0) {
+			ClientData->SavedMoves.Last()->bForceNoCombine = true;
+		}
+	}
+	bTeleportedThisMove = false;
+}
+
+bool UPortalCharacterMovementComponent::HasRecentTeleport(const APortal* Portal) const {
+	return LastTeleportPortal.Get() == Portal && LastTeleportTime >= 0.0f && GetWorld()->TimeSince(LastTeleportTime) < TeleportGraceTime;
+}
+
+bool UPortalCharacterMovementComponent::ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientLoc, const FVector& RelativeClientLoc, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) {
+	if (!Super::ServerCheckClientError(ClientTimeStamp, DeltaTime, Accel, ClientLoc, RelativeClientLoc, ClientMovementBase, ClientBaseBoneName, ClientMovementMode)) {
+		PortalErrorStartTime = -1.0f;
+		return false;
+	}
+
+	float CurrentTime = GetWorld()->GetTimeSeconds();
+	if (PortalErrorStartTime < 0.0f) {
+		PortalErrorStartTime = CurrentTime;
+	}
+
+	// The server gets the last word if its own simulation doesn't catch up in time
+	if (CurrentTime - PortalErrorStartTime < TeleportGraceTime && IsErrorThroughPortal(UpdatedComponent->GetComponentLocation(), ClientLoc)) {
+		NumForgivenErrors += 1;
+		return false;
+	}
+
+	PortalErrorStartTime = -1.0f;
+	return true;
+}
+
+// Either side may have gone through first, so try the mapping both ways through every portal near the two positions
+bool UPortalCharacterMovementComponent::IsErrorThroughPortal(const FVector& ServerLoc, const FVector& ClientLoc) {
+	auto& Registry = FPortalRegistry::Get(GetWorld());
+
+	NearbyPortals.Reset();
+	Registry.QueryBox(FBox(ServerLoc, ServerLoc).ExpandBy(TeleportErrorTolerance), NearbyPortals);
+	Registry.QueryBox(FBox(ClientLoc, ClientLoc).ExpandBy(TeleportErrorTolerance), NearbyPortals);
+
+	float ToleranceSquared = FMath::Square(TeleportErrorTolerance);
+	for (APortal* Portal : NearbyPortals) {
+		if (!Portal->GetTarget()) {
+			continue;
+		}
+
+		FVector ServerThrough = Portal->GetTeleportTransform(FTransform(ServerLoc)).GetLocation();
+		FVector ClientThrough = Portal->GetTeleportTransform(FTransform(ClientLoc)).GetLocation();
+
+		if (FVector::DistSquared(ServerThrough, ClientLoc) < ToleranceSquared || FVector::DistSquared(ClientThrough, ServerLoc) < ToleranceSquared) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// The server may correct a move before or after its own crossing, so compare with where the client had the character
+bool UPortalCharacterMovementComponent::IsCorrectionBeforeTeleport(float TimeStamp, const FVector& ServerLoc) const {
+	const APortal* Portal = LastTeleportPortal.Get();
+	if (!Portal || !Portal->GetTarget() || !HasRecentTeleport(Portal) || !HasPredictionData_Client()) {
+		return false;
+	}
+
+	// Acked moves are gone, the location now is the best guess left
+	FVector ClientLoc = UpdatedComponent->GetComponentLocation();
+	auto ClientData = GetPredictionData_Client_Character();
+	int32 MoveIndex = ClientData->GetSavedMoveIndex(TimeStamp);
+	if (MoveIndex != INDEX_NONE) {
+		ClientLoc = ClientData->SavedMoves[MoveIndex]->SavedLocation;
+	}
+
+	FVector ServerThrough = Portal->GetTeleportTransform(FTransform(ServerLoc)).GetLocation();
+	return FVector::DistSquared(ServerThrough, ClientLoc) < FVector::DistSquared(ServerLoc, ClientLoc);
+}
+
+static FAutoConsoleCommandWithWorld PortalNetStatsCommand(
+	TEXT("Portal.NetStats"),
+	TEXT("Prints teleports, corrections, corrections carried through portals and forgiven portal errors of the characters in the world"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World) {
+		for (TObjectIterator<UPortalCharacterMovementComponent> It; It; ++It) {
+			if (It->GetWorld() != World || !It->GetOwner()) {
+				continue;
+			}
+
+			UE_LOG(LogPortal, Display, TEXT("%s: teleports: %u, corrections: %u, carried corrections: %u, forgiven portal errors: %u"),
+				*It->GetOwner()->GetName(), It->GetNumTeleports(), It->GetNumCorrections(), It->GetNumCarriedCorrections(), It->GetNumForgivenErrors());
+		}
+	})
+);
+
+void UPortalCharacterMovementComponent::ClientAdjustPosition_Implementation(float TimeStamp, FVector NewLoc, FVector NewVel, UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase, bool bBaseRelativePosition, uint8 ServerMovementMode) {
+	NumCorrections += 1;
+
+	// The moves after this one were carried through the portal, the server's location has to follow them
+	if (!bBaseRelativePosition && IsCorrectionBeforeTeleport(TimeStamp, NewLoc)) {
+		const APortal* Portal = LastTeleportPortal.Get();
+		NewLoc = Portal->GetTeleportTransform(FTransform(NewLoc)).GetLocation();
+		NewVel = Portal->GetTeleportDirection(NewVel);
+		NumCarriedCorrections += 1;
+	}
+
+	Super::ClientAdjustPosition_Implementation(TimeStamp, NewLoc, NewVel, NewBase, NewBaseBoneName, bHasBase, bBaseRelativePosition, ServerMovementMode);
+}
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "PortalCooldownTable.h"
+
+
+void FPortalCooldownTable::Add(AActor* Actor, float ExpiryTime) {
+	int32 Index = Find(Actor);
+	if (Index != INDEX_NONE) {
+		Entries[Index].ExpiryTime = FMath::Max(Entries[Index].ExpiryTime, ExpiryTime);
+		return;
+	}
+
+	Indices.Add(Actor, Entries.Add({ Actor, ExpiryTime }));
+}
+
+void FPortalCooldownTable::Remove(const AActor* Actor) {
+	int32 Index = Find(Actor);
+	if (Index != INDEX_NONE) {
+		RemoveAt(Index);
+	}
+}
+
+bool FPortalCooldownTable::Contains(const AActor* Actor) const {
+	return Find(Actor) != INDEX_NONE;
+}
+
+void FPortalCooldownTable::Sweep(float CurrentTime) {
+	for (int32 Index = Entries.Num() - 1; Index >= 0; Index--) {
+		if (Entries[Index].ExpiryTime <= CurrentTime || !Entries[Index].Actor.IsValid()) {
+			RemoveAt(Index);
+		}
+	}
+}
+
+int32 FPortalCooldownTable::Find(const AActor* Actor) const {
+	const int32* Index = Indices.Find(TWeakObjectPtr<AActor>(const_cast<AActor*>(Actor)));
+	return Index ? *Index : INDEX_NONE;
+}
+
+void FPortalCooldownTable::RemoveAt(int32 Index) {
+	Indices.Remove(Entries[Index].Actor);
+	Entries.RemoveAtSwap(Index, 1, false);
+
+	// The last entry took the removed one's place
+	if (Index < Entries.Num()) {
+		Indices.Add(Entries[Index].Actor, Index);
+	}
+}
@@ -0,0 +1,413 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "AI/Navigation/NavigationSystem.h"
+#include "Portal.h"
+#include "PortalStats.h"
+#include "PortalGraph.h"
+
+
+TMap<TWeakObjectPtr<UWorld>, TSharedPtr<FPortalGraph>> FPortalGraph::Graphs;
+
+FPortalGraph& FPortalGraph::Get(UWorld* World) {
+	TSharedPtr<FPortalGraph>* Graph = Graphs.Find(World);
+	if (Graph) {
+		return **Graph;
+	}
+
+	// Drop graphs of worlds which have been torn down
+	for (auto It = Graphs.CreateIterator(); It; ++It) {
+		if (!It.Key().IsValid()) {
+			It.RemoveCurrent();
+		}
+	}
+
+	return *Graphs.Add(World, MakeShareable(new FPortalGraph(World)));
+}
+
+FPortalGraph::FPortalGraph(UWorld* InWorld): World(InWorld) {
+}
+
+void FPortalGraph::Add(APortal* Portal) {
+	if (!Nodes.Contains(Portal)) {
+		Nodes.Add(Portal);
+		bNeedsRebuild = true;
+	}
+}
+
+void FPortalGraph::Remove(APortal* Portal) {
+	if (Nodes.Remove(Portal) > 0) {
+		ChangedPortals.Remove(Portal);
+		bNeedsRebuild = true;
+	}
+}
+
+void FPortalGraph::Invalidate(APortal* Portal) {
+	if (Nodes.Contains(Portal)) {
+		ChangedPortals.AddUnique(Portal);
+	}
+}
+
+int32 FPortalGraph::Num() const {
+	return Nodes.Num();
+}
+
+float FPortalGraph::GetRouteCost(const APortal* From, const APortal* To) {
+	Update();
+
+	int32 FromIndex = Nodes.IndexOfByKey(From);
+	int32 ToIndex = Nodes.IndexOfByKey(To);
+	if (FromIndex == INDEX_NONE || ToIndex == INDEX_NONE) {
+		return MAX_FLT;
+	}
+
+	return Costs[GetIndex(FromIndex, ToIndex)];
+}
+
+float FPortalGraph::FindRoute(const FVector& Start, const FVector& Goal, TArray<APortal*>& OutPortals) {
+	Update();
+
+	OutPortals.Reset();
+
+	float BestCost = FVector::Dist(Start, Goal);
+	int32 BestFirst = INDEX_NONE;
+	int32 BestLast = INDEX_NONE;
+
+	int32 NumNodes = Nodes.Num();
+	for (int32 First = 0; First < NumNodes; First++) {
+		float ToFirst = FVector::Dist(Start, Nodes[First]->GetEntryLocation());
+		if (ToFirst >= BestCost) {
+			continue;
+		}
+
+		for (int32 Last = 0; Last < NumNodes; Last++) {
+			float Through = Costs[GetIndex(First, Last)];
+			if (Through == MAX_FLT || !Nodes[Last]->GetTarget()) {
+				continue;
+			}
+
+			float Cost = ToFirst + Through + FVector::Dist(Nodes[Last]->GetExitLocation(), Goal);
+			if (Cost < BestCost) {
+				BestCost = Cost;
+				BestFirst = First;
+				BestLast = Last;
+			}
+		}
+	}
+
+	if (BestFirst != INDEX_NONE) {
+		for (int32 Node = BestFirst; Node != BestLast; Node = Next[GetIndex(Node, BestLast)]) {
+			OutPortals.Add(Nodes[Node]);
+		}
+		OutPortals.Add(Nodes[BestLast]);
+	}
+
+	return BestCost;
+}
+
+void FPortalGraph::Update() {
+	if (bNeedsRebuild) {
+		Rebuild();
+		return;
+	}
+
+	if (ChangedPortals.Num() == 0) {
+		return;
+	}
+
+	PORTAL_SCOPE_CYCLE_COUNTER(UpdateGraph);
+
+	TArray<int32> ChangedRows;
+	TArray<int32> ChangedColumns;
+	GetChangedEdges(ChangedRows, ChangedColumns);
+	ChangedPortals.Reset();
+
+	int32 NumNodes = Nodes.Num();
+	TArray<bool> IncreasedEdges;
+	TArray<TPair<int32, int32>, TInlineAllocator<64>> CheaperEdges;
+
+	auto ApplyEdge = [&](int32 From, int32 To) {
+		float OldCost = EdgeCosts[GetIndex(From, To)];
+		if (!UpdateEdge(From, To)) {
+			return;
+		}
+
+		if (EdgeCosts[GetIndex(From, To)] > OldCost) {
+			if (IncreasedEdges.Num() == 0) {
+				IncreasedEdges.Init(false, NumNodes * NumNodes);
+			}
+			IncreasedEdges[GetIndex(From, To)] = true;
+		} else {
+			CheaperEdges.Add(TPair<int32, int32>(From, To));
+		}
+	};
+
+	for (int32 Row : ChangedRows) {
+		for (int32 To = 0; To < NumNodes; To++) {
+			ApplyEdge(Row, To);
+		}
+	}
+	for (int32 Column : ChangedColumns) {
+		for (int32 From = 0; From < NumNodes; From++) {
+			ApplyEdge(From, Column);
+		}
+	}
+
+	// Edges getting more expensive only break the routes which took them, the other routes stay the cheapest
+	if (IncreasedEdges.Num() > 0) {
+		TArray<bool> AffectedRows;
+		FindAffectedRows(IncreasedEdges, AffectedRows);
+
+		for (int32 From = 0; From < NumNodes; From++) {
+			if (AffectedRows[From]) {
+				ComputeRow(From);
+			}
+		}
+	}
+
+	for (auto& Edge : CheaperEdges) {
+		RelaxEdge(Edge.Key, Edge.Value);
+	}
+}
+
+// A portal moving changes the edges into it, and out of the portals leading to it.
+// Retargeting changes the edges out of it.
+void FPortalGraph::GetChangedEdges(TArray<int32>& OutRows, TArray<int32>& OutColumns) const {
+	for (APortal* Portal : ChangedPortals) {
+		int32 Index = Nodes.IndexOfByKey(Portal);
+		OutRows.AddUnique(Index);
+		OutColumns.AddUnique(Index);
+
+		for (int32 Other = 0; Other < Nodes.Num(); Other++) {
+			if (Nodes[Other]->GetTarget() == Portal) {
+				OutRows.AddUnique(Other);
+			}
+		}
+	}
+}
+
+// Floyd-Warshall over all portals
+void FPortalGraph::Rebuild() {
+	PORTAL_SCOPE_CYCLE_COUNTER(UpdateGraph);
+
+	bNeedsRebuild = false;
+
+	int32 NumNodes = Nodes.Num();
+	TArray<bool> ChangedRows;
+	TArray<bool> ChangedColumns;
+	ChangedRows.Init(false, NumNodes);
+	ChangedColumns.Init(false, NumNodes);
+
+	TArray<int32> ChangedRowIndices;
+	TArray<int32> ChangedColumnIndices;
+	GetChangedEdges(ChangedRowIndices, ChangedColumnIndices);
+	ChangedPortals.Reset();
+
+	for (int32 Row : ChangedRowIndices) {
+		ChangedRows[Row] = true;
+	}
+	for (int32 Column : ChangedColumnIndices) {
+		ChangedColumns[Column] = true;
+	}
+
+	// Path lengths are the expensive part, edges between portals which were already there and didn't change are kept
+	int32 NumCached = EdgeNodes.Num();
+	TArray<float> CachedCosts = MoveTemp(EdgeCosts);
+	TArray<int32> CachedIndices;
+	CachedIndices.SetNumUninitialized(NumNodes);
+	for (int32 Node = 0; Node < NumNodes; Node++) {
+		CachedIndices[Node] = EdgeNodes.IndexOfByKey(Nodes[Node]);
+	}
+
+	EdgeCosts.SetNumUninitialized(NumNodes * NumNodes);
+	Costs.SetNumUninitialized(NumNodes * NumNodes);
+	Next.SetNumUninitialized(NumNodes * NumNodes);
+
+	for (int32 From = 0; From < NumNodes; From++) {
+		for (int32 To = 0; To < NumNodes; To++) {
+			int32 Index = GetIndex(From, To);
+			int32 CachedFrom = CachedIndices[From];
+			int32 CachedTo = CachedIndices[To];
+
+			if (CachedFrom != INDEX_NONE && CachedTo != INDEX_NONE && !ChangedRows[From] && !ChangedColumns[To]) {
+				EdgeCosts[Index] = CachedCosts[CachedFrom * NumCached + CachedTo];
+			} else {
+				EdgeCosts[Index] = ComputeEdgeCost(From, To);
+			}
+
+			Costs[Index] = From == To ? 0.0f : EdgeCosts[Index];
+			Next[Index] = To;
+		}
+	}
+	EdgeNodes = Nodes;
+
+	for (int32 Via = 0; Via < NumNodes; Via++) {
+		for (int32 From = 0; From < NumNodes; From++) {
+			float FromVia = Costs[GetIndex(From, Via)];
+			if (FromVia == MAX_FLT) {
+				continue;
+			}
+
+			for (int32 To = 0; To < NumNodes; To++) {
+				float ViaTo = Costs[GetIndex(Via, To)];
+				if (ViaTo != MAX_FLT && FromVia + ViaTo < Costs[GetIndex(From, To)]) {
+					Costs[GetIndex(From, To)] = FromVia + ViaTo;
+					Next[GetIndex(From, To)] = Next[GetIndex(From, Via)];
+				}
+			}
+		}
+	}
+}
+
+// Rows with a route taking one of the edges. Routes to the same portal form a tree along Next,
+// so every column is walked once, remembering for each node whether its route takes an edge
+void FPortalGraph::FindAffectedRows(const TArray<bool>& IncreasedEdges, TArray<bool>& OutRows) const {
+	enum EState: uint8 {
+		Unknown,
+		Unaffected,
+		Affected,
+	};
+
+	int32 NumNodes = Nodes.Num();
+	OutRows.Init(false, NumNodes);
+
+	TArray<uint8> States;
+	TArray<int32> Chain;
+	for (int32 To = 0; To < NumNodes; To++) {
+		States.Init(Unknown, NumNodes);
+		States[To] = Unaffected;
+
+		for (int32 From = 0; From < NumNodes; From++) {
+			if (States[From] == Unknown && Costs[GetIndex(From, To)] == MAX_FLT) {
+				States[From] = Unaffected;
+			}
+
+			Chain.Reset();
+			int32 Node = From;
+			while (States[Node] == Unknown) {
+				int32 NextNode = Next[GetIndex(Node, To)];
+
+				// A chain longer than the graph loops, recompute it rather than trust it
+				if (IncreasedEdges[GetIndex(Node, NextNode)] || Chain.Num() >= NumNodes) {
+					States[Node] = Affected;
+					break;
+				}
+
+				Chain.Add(Node);
+				Node = NextNode;
+			}
+
+			for (int32 ChainNode : Chain) {
+				States[ChainNode] = States[Node];
+			}
+
+			OutRows[From] |= States[From] == Affected;
+		}
+	}
+}
+
+// Dijkstra from one portal over the direct edges, O(n^2) on the complete graph
+void FPortalGraph::ComputeRow(int32 From) {
+	int32 NumNodes = Nodes.Num();
+	for (int32 To = 0; To < NumNodes; To++) {
+		Costs[GetIndex(From, To)] = MAX_FLT;
+		Next[GetIndex(From, To)] = To;
+	}
+	Costs[GetIndex(From, From)] = 0.0f;
+
+	TArray<bool> Visited;
+	Visited.Init(false, NumNodes);
+
+	for (int32 Step = 0; Step < NumNodes; Step++) {
+		int32 Closest = INDEX_NONE;
+		float ClosestCost = MAX_FLT;
+		for (int32 Node = 0; Node < NumNodes; Node++) {
+			if (!Visited[Node] && Costs[GetIndex(From, Node)] < ClosestCost) {
+				Closest = Node;
+				ClosestCost = Costs[GetIndex(From, Node)];
+			}
+		}
+
+		// The remaining portals can't be reached
+		if (Closest == INDEX_NONE) {
+			break;
+		}
+		Visited[Closest] = true;
+
+		for (int32 To = 0; To < NumNodes; To++) {
+			float EdgeCost = EdgeCosts[GetIndex(Closest, To)];
+			if (Visited[To] || EdgeCost == MAX_FLT) {
+				continue;
+			}
+
+			float Cost = ClosestCost + EdgeCost;
+			if (Cost < Costs[GetIndex(From, To)]) {
+				Costs[GetIndex(From, To)] = Cost;
+				Next[GetIndex(From, To)] = Closest == From ? To : Next[GetIndex(From, Closest)];
+			}
+		}
+	}
+}
+
+// Routes which get cheaper by taking the edge, in O(n^2) instead of a full rebuild
+void FPortalGraph::RelaxEdge(int32 EdgeFrom, int32 EdgeTo) {
+	float EdgeCost = EdgeCosts[GetIndex(EdgeFrom, EdgeTo)];
+	if (EdgeCost == MAX_FLT) {
+		return;
+	}
+
+	int32 NumNodes = Nodes.Num();
+	for (int32 From = 0; From < NumNodes; From++) {
+		float ToEdge = Costs[GetIndex(From, EdgeFrom)];
+		if (ToEdge == MAX_FLT) {
+			continue;
+		}
+
+		for (int32 To = 0; To < NumNodes; To++) {
+			float FromEdge = Costs[GetIndex(EdgeTo, To)];
+			if (FromEdge == MAX_FLT) {
+				continue;
+			}
+
+			float Cost = ToEdge + EdgeCost + FromEdge;
+			if (Cost < Costs[GetIndex(From, To)]) {
+				Costs[GetIndex(From, To)] = Cost;
+				Next[GetIndex(From, To)] = From == EdgeFrom ? EdgeTo : Next[GetIndex(From, EdgeFrom)];
+			}
+		}
+	}
+}
+
+// Returns whether the edge cost changed
+bool FPortalGraph::UpdateEdge(int32 From, int32 To) {
+	float Cost = ComputeEdgeCost(From, To);
+	float& EdgeCost = EdgeCosts[GetIndex(From, To)];
+	if (Cost == EdgeCost) {
+		return false;
+	}
+
+	EdgeCost = Cost;
+	return true;
+}
+
+float FPortalGraph::ComputeEdgeCost(int32 From, int32 To) const {
+	if (From == To || !Nodes[From]->GetTarget()) {
+		return MAX_FLT;
+	}
+
+	FVector Start = Nodes[From]->GetExitLocation();
+	FVector End = Nodes[To]->GetEntryLocation();
+
+	// Walking distance on the navmesh when there is one, straight distance otherwise
+	UNavigationSystem* NavigationSystem = UNavigationSystem::GetCurrent<UNavigationSystem>(World.Get());
+	if (NavigationSystem && NavigationSystem->GetMainNavData(FNavigationSystem::DontCreate)) {
+		float PathLength = 0.0f;
+		if (NavigationSystem->GetPathLength(Start, End, PathLength) != ENavigationQueryResult::Success) {
+			return MAX_FLT;
+		}
+
+		return PathLength;
+	}
+
+	return FVector::Dist(Start, End);
+}
@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "PortalHiddenSet.h"
+
+
+FPortalHiddenSet::FPortalHiddenSet(USceneCaptureComponent2D* InCapture): Capture(InCapture) {
+	Capture->HiddenComponents.Reset();
+}
+
+void FPortalHiddenSet::BeginUpdate() {
+	Pass += 1;
+}
+
+void FPortalHiddenSet::Hide(UPrimitiveComponent* Component) {
+	auto& HiddenComponents = Capture->HiddenComponents;
+
+	int32* Index = Indices.Find(Component);
+	if (Index) {
+		// A destroyed component's address may have been reused by a new one
+		if (HiddenComponents[*Index].Get() != Component) {
+			HiddenComponents[*Index] = Component;
+		}
+
+		Passes[*Index] = Pass;
+		return;
+	}
+
+	Indices.Add(Component, HiddenComponents.Num());
+	HiddenComponents.Add(Component);
+	Components.Add(Component);
+	Passes.Add(Pass);
+}
+
+void FPortalHiddenSet::EndUpdate() {
+	auto& HiddenComponents = Capture->HiddenComponents;
+
+	for (int32 Index = HiddenComponents.Num() - 1; Index >= 0; Index--) {
+		if (Passes[Index] == Pass) {
+			continue;
+		}
+
+		// Fill the gap with the last entry, and point its index there
+		int32 LastIndex = HiddenComponents.Num() - 1;
+		Indices.Remove(Components[Index]);
+		if (Index != LastIndex) {
+			Indices.FindChecked(Components[LastIndex]) = Index;
+		}
+
+		HiddenComponents.RemoveAtSwap(Index, 1, false);
+		Components.RemoveAtSwap(Index, 1, false);
+		Passes.RemoveAtSwap(Index, 1, false);
+	}
+}
+
+int32 FPortalHiddenSet::Num() const {
+	return Capture->HiddenComponents.Num();
+}
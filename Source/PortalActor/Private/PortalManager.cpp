@@ -0,0 +1,237 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Async/ParallelFor.h"
+#include "Engine/LocalPlayer.h"
+#include "StereoRendering.h"
+#include "PortalMath.h"
+#include "PortalRegistry.h"
+#include "PortalStats.h"
+#include "PortalManager.h"
+
+
+APortalManager::APortalManager() {
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+APortalManager* APortalManager::Get(UWorld* World) {
+	APortalManager* Manager = Find(World);
+	if (Manager) {
+		return Manager;
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.ObjectFlags |= RF_Transient;
+
+	return World->SpawnActor<APortalManager>(SpawnParameters);
+}
+
+APortalManager* APortalManager::Find(UWorld* World) {
+	for (TActorIterator<APortalManager> It(World); It; ++It) {
+		if (!It->IsPendingKill()) {
+			return *It;
+		}
+	}
+
+	return nullptr;
+}
+
+void APortalManager::Register(APortal* Portal) {
+	Portals.AddUnique(Portal);
+}
+
+void APortalManager::Unregister(APortal* Portal) {
+	Portals.Remove(Portal);
+}
+
+void APortalManager::ClearCooldowns(const AActor* Actor) {
+	for (APortal* Portal : Portals) {
+		Portal->TeleportedActors.Remove(Actor);
+		Portal->ReceivedActors.Remove(Actor);
+	}
+}
+
+void APortalManager::Tick(float DeltaTime) {
+	Super::Tick(DeltaTime);
+
+	PORTAL_SCOPE_CYCLE_COUNTER(Tick);
+
+	float CurrentTime = GetWorld()->GetTimeSeconds();
+	for (APortal* Portal : Portals) {
+		Portal->SweepCooldowns(CurrentTime);
+	}
+
+	FPortalRegistry::Get(GetWorld()).UpdateMovers();
+
+	for (APortal* Portal : Portals) {
+		Portal->UpdateNavLink();
+	}
+
+	GatherCameras();
+	GatherPortals();
+
+	int32 NumCameras = Cameras.Num();
+	Views.SetNumUninitialized(Portals.Num() * NumCameras, false);
+	VisibleViews.SetNumUninitialized(Portals.Num() * NumCameras, false);
+
+	{
+		PORTAL_SCOPE_CYCLE_COUNTER(GatherViews);
+
+		// Only reads the gathered arrays and writes its own view, so every portal and camera pair can run in parallel
+		ParallelFor(Views.Num(), [this, NumCameras](int32 Index) {
+			int32 PortalIndex = Index / NumCameras;
+			VisibleViews[Index] = ActivePortals[PortalIndex] && ComputePlayerView(PortalIndex, Cameras[Index % NumCameras], Views[Index]);
+		});
+	}
+
+	// Captures, components and nested portal views have to be set up on the game thread
+	for (int32 PortalIndex = 0; PortalIndex < Portals.Num(); PortalIndex++) {
+		APortal* Portal = Portals[PortalIndex];
+
+		Portal->PlayerViews.Reset();
+		for (int32 CameraIndex = 0; CameraIndex < NumCameras; CameraIndex++) {
+			int32 Index = PortalIndex * NumCameras + CameraIndex;
+			if (VisibleViews[Index]) {
+				Portal->PlayerViews.Add(Views[Index]);
+			}
+		}
+
+		Portal->UpdateCapture();
+	}
+
+	// Only once every portal had its chance to render for the others, which marks their slots as used
+	for (APortal* Portal : Portals) {
+		if (!Portal->TargetCapture) {
+			continue;
+		}
+
+		Portal->ReleaseIdleRenderTargets();
+		Portal->EvictRequesterSlots();
+		Portal->UpdateSightTraces();
+	}
+}
+
+FIntPoint APortalManager::GetViewportSize() const {
+	// Headless runs (benchmarks, -nullrhi) have no viewport, size captures as if on a 720p screen
+	auto GameViewport = GetWorld()->GetGameViewport();
+	if (!GameViewport) {
+		return FIntPoint(1280, 720);
+	}
+
+	FVector2D ViewportSize;
+	GameViewport->GetViewportSize(ViewportSize);
+
+	return FIntPoint(ViewportSize.X, ViewportSize.Y);
+}
+
+FIntPoint APortalManager::GetPlayerViewSize(const APlayerController* PlayerController) const {
+	FIntPoint ViewportSize = GetViewportSize();
+
+	// Splitscreen players only get their slice of the viewport
+	auto LocalPlayer = PlayerController->GetLocalPlayer();
+	if (!LocalPlayer) {
+		return ViewportSize;
+	}
+
+	return FIntPoint(FMath::RoundToInt(ViewportSize.X * LocalPlayer->Size.X), FMath::RoundToInt(ViewportSize.Y * LocalPlayer->Size.Y));
+}
+
+static FTransform GetEyeTransform(const UWorld* World, EStereoscopicPass Eye, const FVector& CameraLocation, const FRotator& CameraRotation) {
+	FVector EyeLocation = CameraLocation;
+	FRotator EyeRotation = CameraRotation;
+	GEngine->StereoRenderingDevice->CalculateStereoViewOffset(Eye, EyeRotation, World->GetWorldSettings()->WorldToMeters, EyeLocation);
+
+	return FTransform(EyeRotation, EyeLocation);
+}
+
+void APortalManager::GatherCameras() {
+	Cameras.Reset();
+
+	// With an HMD, or -emulatestereo, each eye gets half of the view and a capture from its own position
+	bool bStereo = GEngine->StereoRenderingDevice.IsValid() && GEngine->StereoRenderingDevice->IsStereoEnabled();
+
+	for (auto It = GetWorld()->GetPlayerControllerIterator(); It; ++It) {
+		APlayerController* PlayerController = It->Get();
+		if (!PlayerController || !PlayerController->IsLocalController() || !PlayerController->PlayerCameraManager) {
+			continue;
+		}
+
+		auto PlayerCamera = PlayerController->PlayerCameraManager;
+		FVector CameraLocation = PlayerCamera->GetCameraLocation();
+		FRotator CameraRotation = PlayerCamera->GetCameraRotation();
+
+		FPortalCamera Camera;
+		Camera.PlayerController = PlayerController;
+		Camera.Location = CameraLocation;
+		Camera.Transform = FTransform(CameraRotation, CameraLocation);
+		Camera.bStereo = bStereo;
+
+		Camera.ViewSize = GetPlayerViewSize(PlayerController);
+		if (bStereo) {
+			Camera.ViewSize.X = FMath::Max(Camera.ViewSize.X / 2, 1);
+			Camera.LeftEye = GetEyeTransform(GetWorld(), eSSP_LEFT_EYE, CameraLocation, CameraRotation);
+			Camera.RightEye = GetEyeTransform(GetWorld(), eSSP_RIGHT_EYE, CameraLocation, CameraRotation);
+		}
+
+		float AspectRatio = (float)Camera.ViewSize.X / FMath::Max(Camera.ViewSize.Y, 1);
+		Camera.ViewProjection = FPortalMath::MakeViewProjectionMatrix(CameraLocation, CameraRotation, PlayerCamera->GetFOVAngle(), AspectRatio);
+		GetViewFrustumBounds(Camera.Frustum, Camera.ViewProjection, false);
+
+		Cameras.Add(Camera);
+	}
+}
+
+void APortalManager::GatherPortals() {
+	int32 NumPortals = Portals.Num();
+	ActivePortals.SetNumUninitialized(NumPortals, false);
+	Locations.SetNumUninitialized(NumPortals, false);
+	Forwards.SetNumUninitialized(NumPortals, false);
+	Bounds.SetNumUninitialized(NumPortals, false);
+	PairTransforms.SetNum(NumPortals, false);
+
+	for (int32 Index = 0; Index < NumPortals; Index++) {
+		APortal* Portal = Portals[Index];
+
+		ActivePortals[Index] = Portal->IsCaptureActive();
+		if (!ActivePortals[Index]) {
+			continue;
+		}
+
+		Locations[Index] = Portal->GetActorLocation();
+		Forwards[Index] = Portal->GetActorForwardVector();
+		Bounds[Index] = Portal->GetPortalBounds();
+
+		// Refreshes the portal's cached transform here, the parallel pass only reads the copy
+		PairTransforms[Index] = Portal->GetPairTransform();
+	}
+}
+
+bool APortalManager::ComputePlayerView(int32 PortalIndex, const FPortalCamera& Camera, FPortalPlayerView& OutView) const {
+	// Cameras behind the portal can't see through it
+	FVector ToCamera = Camera.Location - Locations[PortalIndex];
+	if (FVector::DotProduct(ToCamera, Forwards[PortalIndex]) < 0) {
+		return false;
+	}
+
+	const FBox& PortalBounds = Bounds[PortalIndex];
+	if (!Camera.Frustum.IntersectBox(PortalBounds.GetCenter(), PortalBounds.GetExtent())) {
+		return false;
+	}
+
+	OutView.PlayerController = Camera.PlayerController;
+	OutView.ViewSize = Camera.ViewSize;
+	OutView.ResolutionScale = FMath::Sqrt(FPortalMath::GetScreenCoverage(PortalBounds, Camera.ViewProjection));
+	OutView.Distance = ToCamera.Size();
+	OutView.bStereo = Camera.bStereo;
+	OutView.Group = INDEX_NONE;
+	OutView.bLeader = false;
+
+	const FPortalPairTransform& PairTransform = PairTransforms[PortalIndex];
+	APortal::TransformThroughPortal(PairTransform, &Camera.Transform, &OutView.CaptureTransform, 1, true);
+	if (Camera.bStereo) {
+		APortal::TransformThroughPortal(PairTransform, &Camera.LeftEye, &OutView.LeftCaptureTransform, 1, true);
+		APortal::TransformThroughPortal(PairTransform, &Camera.RightEye, &OutView.RightCaptureTransform, 1, true);
+	}
+
+	return true;
+}
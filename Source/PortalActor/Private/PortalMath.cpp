@@ -0,0 +1,140 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "SceneManagement.h"
+#include "PortalMath.h"
+
+
+FMatrix FPortalMath::MakeViewMatrix(const FVector& ViewLocation, const FRotator& ViewRotation) {
+	// Swap axes from Unreal's X-forward to the renderer's Z-forward
+	return FTranslationMatrix(-ViewLocation) * FInverseRotationMatrix(ViewRotation) * FMatrix(
+		FPlane(0, 0, 1, 0),
+		FPlane(1, 0, 0, 0),
+		FPlane(0, 1, 0, 0),
+		FPlane(0, 0, 0, 1));
+}
+
+FMatrix FPortalMath::MakeProjectionMatrix(float FOVDegrees, float AspectRatio) {
+	float HalfFOV = FMath::DegreesToRadians(FMath::Max(FOVDegrees, 0.001f)) * 0.5f;
+	return FReversedZPerspectiveMatrix(HalfFOV, HalfFOV, 1.0f, FMath::Max(AspectRatio, KINDA_SMALL_NUMBER), GNearClippingPlane, GNearClippingPlane);
+}
+
+FMatrix FPortalMath::MakeViewProjectionMatrix(const FVector& ViewLocation, const FRotator& ViewRotation, float FOVDegrees, float AspectRatio) {
+	return MakeViewMatrix(ViewLocation, ViewRotation) * MakeProjectionMatrix(FOVDegrees, AspectRatio);
+}
+
+// Eric Lengyel's oblique near-plane clipping, adapted to the reversed Z projection:
+// http://www.terathon.com/lengyel/Lengyel-Oblique.pdf
+FMatrix FPortalMath::MakeObliqueProjectionMatrix(const FMatrix& ProjectionMatrix, const FMatrix& ViewMatrix, const FPlane& ClipPlane) {
+	// Clip plane in view space, as a 4D vector which is positive on the visible side
+	FVector ViewNormal = ViewMatrix.TransformVector(ClipPlane.GetSafeNormal());
+	FVector ViewBase = ViewMatrix.TransformPosition(ClipPlane.GetSafeNormal() * ClipPlane.W);
+	FVector4 Plane(ViewNormal, -FVector::DotProduct(ViewNormal, ViewBase));
+
+	// The viewer is on the clipped side, nothing would be left to draw
+	if (Plane.W >= 0.0f) {
+		return ProjectionMatrix;
+	}
+
+	// Corner of the far plane opposite to the clip plane. The far plane is at depth 0 with reversed Z
+	FVector4 FarCorner = ProjectionMatrix.Inverse().TransformFVector4(FVector4(FMath::Sign(Plane.X), FMath::Sign(Plane.Y), 0.0f, 1.0f));
+
+	FVector4 DepthColumn(ProjectionMatrix.M[0][3], ProjectionMatrix.M[1][3], ProjectionMatrix.M[2][3], ProjectionMatrix.M[3][3]);
+	float PlaneDotCorner = Dot4(Plane, FarCorner);
+	if (FMath::IsNearlyZero(PlaneDotCorner)) {
+		return ProjectionMatrix;
+	}
+
+	// Replace the near plane (W - Z) by the clip plane, and tilt the far plane to pass through the far corner
+	float Scale = Dot4(DepthColumn, FarCorner) / PlaneDotCorner;
+
+	FMatrix ObliqueMatrix = ProjectionMatrix;
+	for (int32 Row = 0; Row < 4; Row++) {
+		ObliqueMatrix.M[Row][2] = DepthColumn[Row] - Scale * Plane[Row];
+	}
+
+	return ObliqueMatrix;
+}
+
+float FPortalMath::GetCaptureAspectRatio(const USceneCaptureComponent2D* Capture) {
+	if (Capture->TextureTarget && Capture->TextureTarget->SizeY > 0) {
+		return (float)Capture->TextureTarget->SizeX / (float)Capture->TextureTarget->SizeY;
+	}
+
+	return 1.0f;
+}
+
+FMatrix FPortalMath::MakeCaptureViewProjection(const USceneCaptureComponent2D* Capture) {
+	return MakeViewProjectionMatrix(Capture->GetComponentLocation(), Capture->GetComponentRotation(), Capture->FOVAngle, GetCaptureAspectRatio(Capture));
+}
+
+FConvexVolume FPortalMath::MakeCaptureFrustum(const USceneCaptureComponent2D* Capture) {
+	FConvexVolume Frustum;
+	GetViewFrustumBounds(Frustum, MakeCaptureViewProjection(Capture), false);
+
+	return Frustum;
+}
+
+FBox FPortalMath::MakeCaptureFrustumBounds(const USceneCaptureComponent2D* Capture, float FarDistance) {
+	FTransform Transform = Capture->GetComponentTransform();
+	FVector Origin = Transform.GetLocation();
+
+	// Corners of the far plane, the horizontal FOV spanning the width
+	float HalfWidth = FarDistance * FMath::Tan(FMath::DegreesToRadians(FMath::Max(Capture->FOVAngle, 0.001f)) * 0.5f);
+	float HalfHeight = HalfWidth / FMath::Max(GetCaptureAspectRatio(Capture), KINDA_SMALL_NUMBER);
+	FVector Forward = Transform.GetUnitAxis(EAxis::X) * FarDistance;
+	FVector Right = Transform.GetUnitAxis(EAxis::Y) * HalfWidth;
+	FVector Up = Transform.GetUnitAxis(EAxis::Z) * HalfHeight;
+
+	FBox Bounds(ForceInit);
+	Bounds += Origin;
+	Bounds += Origin + Forward + Right + Up;
+	Bounds += Origin + Forward + Right - Up;
+	Bounds += Origin + Forward - Right + Up;
+	Bounds += Origin + Forward - Right - Up;
+
+	return Bounds;
+}
+
+bool FPortalMath::IsBoxInView(const FBox& Bounds, const FMatrix& ViewProjection) {
+	FConvexVolume Frustum;
+	GetViewFrustumBounds(Frustum, ViewProjection, false);
+
+	return Frustum.IntersectBox(Bounds.GetCenter(), Bounds.GetExtent());
+}
+
+float FPortalMath::GetScreenCoverage(const FBox& Bounds, const FMatrix& ViewProjection) {
+	float MinX = 1.0f;
+	float MinY = 1.0f;
+	float MaxX = -1.0f;
+	float MaxY = -1.0f;
+
+	for (int32 Corner = 0; Corner < 8; Corner++) {
+		FVector Point(
+			(Corner & 1) ? Bounds.Max.X : Bounds.Min.X,
+			(Corner & 2) ? Bounds.Max.Y : Bounds.Min.Y,
+			(Corner & 4) ? Bounds.Max.Z : Bounds.Min.Z);
+
+		FPlane Projected = ViewProjection.TransformFVector4(FVector4(Point, 1.0f));
+
+		// A corner behind the viewer means the bounds wrap around it, treat as full screen
+		if (Projected.W <= KINDA_SMALL_NUMBER) {
+			return 1.0f;
+		}
+
+		float ScreenX = Projected.X / Projected.W;
+		float ScreenY = Projected.Y / Projected.W;
+		MinX = FMath::Min(MinX, ScreenX);
+		MinY = FMath::Min(MinY, ScreenY);
+		MaxX = FMath::Max(MaxX, ScreenX);
+		MaxY = FMath::Max(MaxY, ScreenY);
+	}
+
+	// Clamp to the visible part of the screen, which spans [-1, 1] on both axes
+	float Width = FMath::Max(FMath::Min(MaxX, 1.0f) - FMath::Max(MinX, -1.0f), 0.0f);
+	float Height = FMath::Max(FMath::Min(MaxY, 1.0f) - FMath::Max(MinY, -1.0f), 0.0f);
+
+	return Width * Height * 0.25f;
+}
@@ -0,0 +1,319 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "PortalActorProjectile.h"
+#include "PortalManager.h"
+#include "PortalStats.h"
+#include "PortalProjectileBatch.h"
+
+
+APortalProjectileBatch::APortalProjectileBatch() {
+	PrimaryActorTick.bCanEverTick = true;
+
+	Instances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(FName("Instances"));
+	Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Instances->bGenerateOverlapEvents = false;
+	RootComponent = Instances;
+}
+
+APortalProjectileBatch* APortalProjectileBatch::Get(UWorld* World, TSubclassOf<APortalActorProjectile> ProjectileClass) {
+	for (TActorIterator<APortalProjectileBatch> It(World); It; ++It) {
+		if (!It->IsPendingKill() && It->ProjectileClass == ProjectileClass) {
+			return *It;
+		}
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.ObjectFlags |= RF_Transient;
+
+	APortalProjectileBatch* Batch = World->SpawnActor<APortalProjectileBatch>(SpawnParameters);
+	Batch->Setup(ProjectileClass);
+	return Batch;
+}
+
+void APortalProjectileBatch::Setup(TSubclassOf<APortalActorProjectile> InProjectileClass) {
+	ProjectileClass = InProjectileClass;
+
+	auto Defaults = ProjectileClass->GetDefaultObject<APortalActorProjectile>();
+	auto Movement = Defaults->GetProjectileMovement();
+
+	Radius = Defaults->GetCollisionComp()->GetUnscaledSphereRadius();
+	CollisionProfile = Defaults->GetCollisionComp()->GetCollisionProfileName();
+	InitialSpeed = Movement->InitialSpeed;
+	MaxSpeed = Movement->MaxSpeed;
+	GravityScale = Movement->ProjectileGravityScale;
+	Bounciness = Movement->Bounciness;
+	Friction = Movement->Friction;
+	bShouldBounce = Movement->bShouldBounce;
+	RestingSpeed = Movement->BounceVelocityStopSimulatingThreshold;
+	LifeSpan = Defaults->InitialLifeSpan;
+}
+
+void APortalProjectileBatch::BeginPlay() {
+	Super::BeginPlay();
+
+	// Get rather than Find, portals may begin play after the batch
+	Manager = APortalManager::Get(GetWorld());
+}
+
+void APortalProjectileBatch::SetMesh(UStaticMesh* Mesh) {
+	Instances->SetStaticMesh(Mesh);
+}
+
+void APortalProjectileBatch::Fire(const FVector& Location, const FVector& Direction) {
+	int32 Index = NumProjectiles;
+	Resize(NumProjectiles + 1);
+
+	FVector Velocity = Direction.GetSafeNormal() * InitialSpeed;
+	PositionX[Index] = Location.X;
+	PositionY[Index] = Location.Y;
+	PositionZ[Index] = Location.Z;
+	VelocityX[Index] = Velocity.X;
+	VelocityY[Index] = Velocity.Y;
+	VelocityZ[Index] = Velocity.Z;
+	Ages[Index] = 0.0f;
+	Moving[Index] = 1.0f;
+}
+
+int32 APortalProjectileBatch::Num() const {
+	return NumProjectiles;
+}
+
+void APortalProjectileBatch::Tick(float DeltaTime) {
+	Super::Tick(DeltaTime);
+
+	PORTAL_SCOPE_CYCLE_COUNTER(ProjectileBatch);
+
+	if (NumProjectiles > 0) {
+		Integrate(DeltaTime);
+		GatherPortals();
+		Collide();
+		Resolve();
+	}
+
+	UpdateInstances();
+
+	PORTAL_INC_COUNTER(BatchedProjectiles, NumProjectiles);
+}
+
+void APortalProjectileBatch::Resize(int32 NewNum) {
+	NumProjectiles = NewNum;
+
+	// Padding entries are zeroed, including those left behind by removed projectiles, so they integrate to nothing
+	int32 PaddedNum = Align(NewNum, 4);
+	for (TArray<float>* Array : { &PositionX, &PositionY, &PositionZ, &VelocityX, &VelocityY, &VelocityZ, &EndX, &EndY, &EndZ, &Ages, &Moving }) {
+		Array->SetNumZeroed(PaddedNum, false);
+		FMemory::Memzero(Array->GetData() + NewNum, (PaddedNum - NewNum) * sizeof(float));
+	}
+	Collisions.SetNum(NewNum, false);
+}
+
+// Gravity and the step along the velocity, four projectiles at a time
+void APortalProjectileBatch::Integrate(float DeltaTime) {
+	VectorRegister Step = VectorSetFloat1(DeltaTime);
+	VectorRegister GravityStep = VectorSetFloat1(GetWorld()->GetGravityZ() * GravityScale * DeltaTime);
+
+	int32 PaddedNum = PositionX.Num();
+	for (int32 Index = 0; Index < PaddedNum; Index += 4) {
+		VectorRegister Moves = VectorLoad(&Moving[Index]);
+		VectorRegister MoveStep = VectorMultiply(Step, Moves);
+
+		VectorRegister VelocityZ4 = VectorMultiplyAdd(GravityStep, Moves, VectorLoad(&VelocityZ[Index]));
+		VectorStore(VelocityZ4, &VelocityZ[Index]);
+
+		VectorStore(VectorMultiplyAdd(VectorLoad(&VelocityX[Index]), MoveStep, VectorLoad(&PositionX[Index])), &EndX[Index]);
+		VectorStore(VectorMultiplyAdd(VectorLoad(&VelocityY[Index]), MoveStep, VectorLoad(&PositionY[Index])), &EndY[Index]);
+		VectorStore(VectorMultiplyAdd(VelocityZ4, MoveStep, VectorLoad(&PositionZ[Index])), &EndZ[Index]);
+
+		VectorStore(VectorAdd(VectorLoad(&Ages[Index]), Step), &Ages[Index]);
+	}
+}
+
+void APortalProjectileBatch::GatherPortals() {
+	Portals.Reset();
+	Openings.Reset();
+
+	if (!Manager.IsValid()) {
+		return;
+	}
+
+	for (APortal* Portal : Manager->GetPortals()) {
+		if (Portal->GetTarget()) {
+			Portals.Add(Portal);
+			Openings.Add(Portal->GetOpening());
+		}
+	}
+}
+
+// Portal openings and sweeps of every projectile. Scene queries are safe off the game thread, the results are only applied in Resolve
+void APortalProjectileBatch::Collide() {
+	UWorld* World = GetWorld();
+	FCollisionShape Shape = FCollisionShape::MakeSphere(Radius);
+	FCollisionQueryParams Params(FName("PortalProjectileBatch"), false, this);
+
+	ParallelFor(NumProjectiles, [this, World, &Shape, &Params](int32 Index) {
+		FCollision& Collision = Collisions[Index];
+		Collision.bHit = false;
+		Collision.Portal = INDEX_NONE;
+
+		FVector Start(PositionX[Index], PositionY[Index], PositionZ[Index]);
+		FVector End(EndX[Index], EndY[Index], EndZ[Index]);
+		if (Start == End) {
+			return;
+		}
+
+		// The first opening along the segment is the portal the projectile goes into
+		Collision.CrossingTime = 1.0f;
+		for (int32 PortalIndex = 0; PortalIndex < Openings.Num(); PortalIndex++) {
+			float Time;
+			if (Openings[PortalIndex].IntersectSegment(Start, End, Time) && Time <= Collision.CrossingTime) {
+				Collision.Portal = PortalIndex;
+				Collision.CrossingTime = Time;
+			}
+		}
+
+		FVector SweepEnd = FMath::Lerp(Start, End, Collision.CrossingTime);
+		if (Collision.Portal == INDEX_NONE) {
+			Collision.bHit = World->SweepSingleByProfile(Collision.Hit, Start, SweepEnd, FQuat::Identity, CollisionProfile, Shape, Params);
+		} else {
+			// The mesh of the portal being crossed would block the sweep up to its opening, other portals still block
+			FCollisionQueryParams CrossingParams = Params;
+			CrossingParams.AddIgnoredActor(Portals[Collision.Portal]);
+			Collision.bHit = World->SweepSingleByProfile(Collision.Hit, Start, SweepEnd, FQuat::Identity, CollisionProfile, Shape, CrossingParams);
+		}
+		if (Collision.bHit) {
+			Collision.Portal = INDEX_NONE;
+		}
+	});
+}
+
+void APortalProjectileBatch::Resolve() {
+	// Backwards, as removing a projectile moves the last one into its place
+	for (int32 Index = NumProjectiles - 1; Index >= 0; Index--) {
+		if (Ages[Index] > LifeSpan) {
+			Remove(Index);
+			continue;
+		}
+
+		const FCollision& Collision = Collisions[Index];
+		FVector Velocity(VelocityX[Index], VelocityY[Index], VelocityZ[Index]);
+		FVector Location(EndX[Index], EndY[Index], EndZ[Index]);
+
+		if (Collision.bHit) {
+			// Same as APortalActorProjectile::OnHit, physics objects get pushed and the projectile goes away.
+			// The hit location of a sweep is where the sphere's center stopped, the actor location OnHit pushes at
+			UPrimitiveComponent* HitComponent = Collision.Hit.GetComponent();
+			if (Collision.Hit.GetActor() && HitComponent && HitComponent->IsSimulatingPhysics()) {
+				HitComponent->AddImpulseAtLocation(Velocity * 100.0f, Collision.Hit.Location);
+				Remove(Index);
+				continue;
+			}
+
+			if (!bShouldBounce) {
+				Remove(Index);
+				continue;
+			}
+
+			Location = Collision.Hit.Location + Collision.Hit.Normal * KINDA_SMALL_NUMBER;
+			Bounce(Index, Collision.Hit, Velocity);
+		} else if (Collision.Portal != INDEX_NONE) {
+			// Comes out of the Target where it went in, then carries on for whatever distance it travelled past the portal
+			FVector Start(PositionX[Index], PositionY[Index], PositionZ[Index]);
+			FVector Crossing = FMath::Lerp(Start, Location, Collision.CrossingTime);
+			FQuat Rotation = Velocity.ToOrientationQuat();
+
+			FTransform Exit = Portals[Collision.Portal]->GetTeleportTransform(FTransform(Rotation, Crossing));
+			FQuat PortalRotation = Exit.GetRotation() * Rotation.Inverse();
+
+			Location = Exit.GetLocation() + PortalRotation.RotateVector(Location - Crossing);
+			Velocity = PortalRotation.RotateVector(Velocity);
+
+			PORTAL_INC_COUNTER(Teleports, 1);
+		}
+
+		// No limit when zero, like the projectile movement component
+		if (MaxSpeed > 0.0f) {
+			Velocity = Velocity.GetClampedToMaxSize(MaxSpeed);
+		}
+
+		PositionX[Index] = Location.X;
+		PositionY[Index] = Location.Y;
+		PositionZ[Index] = Location.Z;
+		VelocityX[Index] = Velocity.X;
+		VelocityY[Index] = Velocity.Y;
+		VelocityZ[Index] = Velocity.Z;
+	}
+}
+
+void APortalProjectileBatch::Bounce(int32 Index, const FHitResult& Hit, FVector& Velocity) {
+	FVector NormalVelocity = Hit.Normal * FVector::DotProduct(Velocity, Hit.Normal);
+	FVector TangentVelocity = Velocity - NormalVelocity;
+
+	Velocity = TangentVelocity * (1.0f - Friction) - NormalVelocity * Bounciness;
+
+	// Resting on the floor, gravity would only push it back in every frame
+	if (Hit.Normal.Z > 0.7f && Velocity.Size() < RestingSpeed) {
+		Velocity = FVector::ZeroVector;
+		Moving[Index] = 0.0f;
+	}
+}
+
+void APortalProjectileBatch::Remove(int32 Index) {
+	int32 Last = NumProjectiles - 1;
+	if (Index != Last) {
+		for (TArray<float>* Array : { &PositionX, &PositionY, &PositionZ, &VelocityX, &VelocityY, &VelocityZ, &EndX, &EndY, &EndZ, &Ages, &Moving }) {
+			(*Array)[Index] = (*Array)[Last];
+		}
+		Collisions[Index] = Collisions[Last];
+	}
+
+	Resize(Last);
+}
+
+// Instance N is always projectile N, so instances are only ever added or removed at the end
+void APortalProjectileBatch::UpdateInstances() {
+	UStaticMesh* Mesh = Instances->GetStaticMesh();
+	if (!Mesh) {
+		return;
+	}
+
+	bool bChanged = Instances->GetInstanceCount() != NumProjectiles;
+	while (Instances->GetInstanceCount() > NumProjectiles) {
+		Instances->RemoveInstance(Instances->GetInstanceCount() - 1);
+	}
+	while (Instances->GetInstanceCount() < NumProjectiles) {
+		Instances->AddInstanceWorldSpace(FTransform::Identity);
+	}
+	InstanceTransforms.SetNum(FMath::Min(InstanceTransforms.Num(), NumProjectiles), false);
+
+	// Scales the mesh to the size of the collision sphere
+	float MeshRadius = Mesh->GetBounds().BoxExtent.GetMax();
+	FVector Scale(MeshRadius > 0.0f ? Radius / MeshRadius : 1.0f);
+
+	for (int32 Index = 0; Index < NumProjectiles; Index++) {
+		FVector Location(PositionX[Index], PositionY[Index], PositionZ[Index]);
+		FVector Velocity(VelocityX[Index], VelocityY[Index], VelocityZ[Index]);
+
+		// Resting projectiles keep their transform, their instances don't need to be sent again
+		FTransform Transform(Velocity.ToOrientationQuat(), Location, Scale);
+		if (InstanceTransforms.IsValidIndex(Index) && InstanceTransforms[Index].Equals(Transform, 0.0f)) {
+			continue;
+		}
+
+		Instances->UpdateInstanceTransform(Index, Transform, true, false, true);
+		bChanged = true;
+
+		if (Index < InstanceTransforms.Num()) {
+			InstanceTransforms[Index] = Transform;
+		} else {
+			InstanceTransforms.Add(Transform);
+		}
+	}
+
+	if (bChanged) {
+		Instances->MarkRenderStateDirty();
+	}
+}
@@ -0,0 +1,209 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Portal.h"
+#include "PortalStats.h"
+#include "PortalProxyRenderer.h"
+
+
+APortalProxyRenderer::APortalProxyRenderer() {
+	PrimaryActorTick.bCanEverTick = true;
+
+	// Once everything moved and animated, so proxies show where their sources ended up this frame
+	PrimaryActorTick.TickGroup = TG_PostUpdateWork;
+
+	RootComponent = CreateDefaultSubobject<USceneComponent>(FName("Root"));
+}
+
+APortalProxyRenderer* APortalProxyRenderer::Get(UWorld* World) {
+	APortalProxyRenderer* Renderer = Find(World);
+	if (Renderer) {
+		return Renderer;
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.ObjectFlags |= RF_Transient;
+
+	return World->SpawnActor<APortalProxyRenderer>(SpawnParameters);
+}
+
+APortalProxyRenderer* APortalProxyRenderer::Find(UWorld* World) {
+	for (TActorIterator<APortalProxyRenderer> It(World); It; ++It) {
+		if (!It->IsPendingKill()) {
+			return *It;
+		}
+	}
+
+	return nullptr;
+}
+
+void APortalProxyRenderer::Register(APortal* Portal) {
+	Portals.AddUnique(Portal);
+}
+
+void APortalProxyRenderer::Unregister(APortal* Portal) {
+	Portals.Remove(Portal);
+}
+
+void APortalProxyRenderer::Tick(float DeltaTime) {
+	Super::Tick(DeltaTime);
+
+	PORTAL_SCOPE_CYCLE_COUNTER(UpdateProxies);
+
+	NumSkeletalProxies = 0;
+
+	for (APortal* Portal : Portals) {
+		if (!Portal->GetTarget()) {
+			continue;
+		}
+
+		StraddlingActors.Reset();
+		Portal->GetStraddlingActors(StraddlingActors);
+
+		for (AActor* Actor : StraddlingActors) {
+			if (Actor->bHidden) {
+				continue;
+			}
+
+			TInlineComponentArray<UMeshComponent*> Meshes(Actor);
+			for (UMeshComponent* Mesh : Meshes) {
+				// First person meshes only make sense from their owner's camera
+				if (!Mesh->IsVisible() || Mesh->bHiddenInGame || Mesh->bOnlyOwnerSee) {
+					continue;
+				}
+
+				// Views through the portal are mirrored the same way as what the proxies show
+				FTransform Transform = Portal->GetTeleportTransform(Mesh->GetComponentTransform(), true);
+				Transform.SetScale3D(Mesh->GetComponentScale());
+
+				if (USkeletalMeshComponent* SkeletalMesh = Cast<USkeletalMeshComponent>(Mesh)) {
+					AddSkeletalProxy(SkeletalMesh, Transform);
+				} else if (UStaticMeshComponent* StaticMesh = Cast<UStaticMeshComponent>(Mesh)) {
+					// Instanced meshes, such as other proxies or bulk projectiles, would need every instance copied
+					if (!StaticMesh->IsA<UInstancedStaticMeshComponent>()) {
+						AddStaticProxy(StaticMesh, Transform);
+					}
+				}
+			}
+		}
+	}
+
+	FlushStaticProxies();
+	HideUnusedSkeletalProxies();
+}
+
+void APortalProxyRenderer::AddStaticProxy(UStaticMeshComponent* Source, const FTransform& Transform) {
+	UStaticMesh* Mesh = Source->GetStaticMesh();
+	if (!Mesh) {
+		return;
+	}
+
+	SourceMaterials.Reset();
+	for (int32 Index = 0; Index < Source->GetNumMaterials(); Index++) {
+		SourceMaterials.Add(Source->GetMaterial(Index));
+	}
+
+	FPortalProxyBatch* Batch = Batches.FindByPredicate([this, Mesh](const FPortalProxyBatch& Candidate) {
+		return Candidate.Mesh == Mesh && Candidate.Materials == SourceMaterials;
+	});
+
+	if (!Batch) {
+		Batch = &Batches[Batches.AddDefaulted()];
+		Batch->Mesh = Mesh;
+		Batch->Materials = SourceMaterials;
+
+		Batch->Instances = NewObject<UInstancedStaticMeshComponent>(this);
+		Batch->Instances->SetStaticMesh(Mesh);
+		for (int32 Index = 0; Index < SourceMaterials.Num(); Index++) {
+			Batch->Instances->SetMaterial(Index, SourceMaterials[Index]);
+		}
+		Batch->Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		Batch->Instances->bGenerateOverlapEvents = false;
+		Batch->Instances->SetupAttachment(RootComponent);
+		Batch->Instances->RegisterComponent();
+	}
+
+	Batch->Transforms.Add(Transform);
+}
+
+void APortalProxyRenderer::AddSkeletalProxy(USkeletalMeshComponent* Source, const FTransform& Transform) {
+	if (!Source->SkeletalMesh) {
+		return;
+	}
+
+	if (NumSkeletalProxies == SkeletalProxies.Num()) {
+		USkeletalMeshComponent* NewProxy = NewObject<USkeletalMeshComponent>(this);
+		NewProxy->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		NewProxy->bGenerateOverlapEvents = false;
+		NewProxy->SetupAttachment(RootComponent);
+		NewProxy->RegisterComponent();
+		SkeletalProxies.Add(NewProxy);
+	}
+
+	USkeletalMeshComponent* Proxy = SkeletalProxies[NumSkeletalProxies++];
+
+	// Only set up again when the proxy is reused for another source
+	if (Proxy->MasterPoseComponent.Get() != Source) {
+		Proxy->SetSkeletalMesh(Source->SkeletalMesh, false);
+		for (int32 Index = 0; Index < Source->GetNumMaterials(); Index++) {
+			Proxy->SetMaterial(Index, Source->GetMaterial(Index));
+		}
+		Proxy->SetMasterPoseComponent(Source);
+	}
+
+	Proxy->SetWorldTransform(Transform);
+	Proxy->SetVisibility(true);
+}
+
+// Instance N of a batch is always transform N, so instances are only ever added or removed at the end
+void APortalProxyRenderer::FlushStaticProxies() {
+	int32 NumProxies = 0;
+
+	for (FPortalProxyBatch& Batch : Batches) {
+		UInstancedStaticMeshComponent* Instances = Batch.Instances;
+		int32 NumTransforms = Batch.Transforms.Num();
+		if (NumTransforms == 0 && Instances->GetInstanceCount() == 0) {
+			continue;
+		}
+
+		bool bChanged = Instances->GetInstanceCount() != NumTransforms;
+		while (Instances->GetInstanceCount() > NumTransforms) {
+			Instances->RemoveInstance(Instances->GetInstanceCount() - 1);
+		}
+		while (Instances->GetInstanceCount() < NumTransforms) {
+			Instances->AddInstanceWorldSpace(FTransform::Identity);
+		}
+
+		// Actors resting in a portal give the same transforms every frame, their instances don't need to be sent again
+		for (int32 Index = 0; Index < NumTransforms; Index++) {
+			const FTransform& Transform = Batch.Transforms[Index];
+			if (Batch.LastTransforms.IsValidIndex(Index) && Batch.LastTransforms[Index].Equals(Transform, 0.0f)) {
+				continue;
+			}
+
+			Instances->UpdateInstanceTransform(Index, Transform, true, false, true);
+			bChanged = true;
+		}
+
+		if (bChanged) {
+			Instances->MarkRenderStateDirty();
+		}
+
+		NumProxies += NumTransforms;
+		Exchange(Batch.Transforms, Batch.LastTransforms);
+		Batch.Transforms.Reset();
+	}
+
+	PORTAL_INC_COUNTER(Proxies, NumProxies + NumSkeletalProxies);
+}
+
+void APortalProxyRenderer::HideUnusedSkeletalProxies() {
+	for (int32 Index = NumSkeletalProxies; Index < SkeletalProxies.Num(); Index++) {
+		USkeletalMeshComponent* Proxy = SkeletalProxies[Index];
+		if (Proxy->IsVisible()) {
+			Proxy->SetVisibility(false);
+			Proxy->SetMasterPoseComponent(nullptr);
+		}
+	}
+}
@@ -0,0 +1,368 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Portal.h"
+#include "PortalStats.h"
+#include "PortalRegistry.h"
+
+
+const float FPortalRegistry::CellSize = 1000.0f;
+
+TMap<TWeakObjectPtr<const UWorld>, TSharedPtr<FPortalRegistry>> FPortalRegistry::Registries;
+
+FPortalRegistry& FPortalRegistry::Get(const UWorld* World) {
+	TSharedPtr<FPortalRegistry>* Registry = Registries.Find(World);
+	if (Registry) {
+		return **Registry;
+	}
+
+	// Drop registries of worlds which have been torn down
+	for (auto It = Registries.CreateIterator(); It; ++It) {
+		if (!It.Key().IsValid()) {
+			It.RemoveCurrent();
+		}
+	}
+
+	return *Registries.Add(World, MakeShareable(new FPortalRegistry()));
+}
+
+void FPortalRegistry::Register(APortal* Portal) {
+	if (Entries.Contains(Portal)) {
+		Update(Portal);
+		return;
+	}
+
+	FEntry Entry;
+	Entry.Bounds = Portal->GetPortalBounds();
+	Entry.MinCell = GetCell(Entry.Bounds.Min);
+	Entry.MaxCell = GetCell(Entry.Bounds.Max);
+
+	AddToCells(Portal, Entry);
+	Entries.Add(Portal, Entry);
+
+	Bounds += Entry.Bounds;
+}
+
+void FPortalRegistry::Unregister(APortal* Portal) {
+	FEntry Entry;
+	if (Entries.RemoveAndCopyValue(Portal, Entry)) {
+		RemoveFromCells(Portal, Entry);
+		bBoundsDirty = true;
+	}
+}
+
+void FPortalRegistry::Update(APortal* Portal) {
+	FEntry* Entry = Entries.Find(Portal);
+	if (!Entry) {
+		return;
+	}
+
+	Entry->Bounds = Portal->GetPortalBounds();
+	bBoundsDirty = true;
+
+	FIntVector MinCell = GetCell(Entry->Bounds.Min);
+	FIntVector MaxCell = GetCell(Entry->Bounds.Max);
+
+	// Most moves stay within the same cells, so only the bounds need refreshing
+	if (MinCell == Entry->MinCell && MaxCell == Entry->MaxCell) {
+		return;
+	}
+
+	RemoveFromCells(Portal, *Entry);
+	Entry->MinCell = MinCell;
+	Entry->MaxCell = MaxCell;
+	AddToCells(Portal, *Entry);
+}
+
+void FPortalRegistry::QueryVolume(const FConvexVolume& Volume, const FBox& VolumeBounds, TArray<APortal*>& OutPortals) const {
+	QueryCounter += 1;
+
+	ForEachCellInBounds(VolumeBounds, [this, &Volume, &OutPortals](const FIntVector& CellKey, const TArray<APortal*>& Cell) {
+		CollectCellInVolume(CellKey, Cell, Volume, OutPortals);
+	});
+}
+
+void FPortalRegistry::QueryBox(const FBox& Box, TArray<APortal*>& OutPortals) const {
+	QueryCounter += 1;
+
+	ForEachCellInBounds(Box, [this, &Box, &OutPortals](const FIntVector& CellKey, const TArray<APortal*>& Cell) {
+		for (APortal* Portal : Cell) {
+			const FEntry& Entry = Entries.FindChecked(Portal);
+			if (Entry.QueryStamp == QueryCounter) {
+				continue;
+			}
+			Entry.QueryStamp = QueryCounter;
+
+			if (Entry.Bounds.Intersect(Box)) {
+				OutPortals.Add(Portal);
+			}
+		}
+	});
+}
+
+// Huge query bounds, such as the path of an actor moved across the level, only walk the cells portals can be in
+void FPortalRegistry::ForEachCellInBounds(const FBox& QueryBounds, TFunctionRef<void(const FIntVector&, const TArray<APortal*>&)> Visit) const {
+	FBox PortalBounds = GetBounds();
+	if (!PortalBounds.IsValid || !QueryBounds.Intersect(PortalBounds)) {
+		return;
+	}
+
+	FBox ClampedBounds = QueryBounds.Overlap(PortalBounds);
+	FIntVector MinCell = GetCell(ClampedBounds.Min);
+	FIntVector MaxCell = GetCell(ClampedBounds.Max);
+
+	// Walks whichever is smaller, the cells within the bounds or the occupied cells
+	int64 NumRangeCells = (int64)(MaxCell.X - MinCell.X + 1) * (MaxCell.Y - MinCell.Y + 1) * (MaxCell.Z - MinCell.Z + 1);
+	if (NumRangeCells <= Cells.Num()) {
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++) {
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++) {
+				for (int32 Z = MinCell.Z; Z <= MaxCell.Z; Z++) {
+					FIntVector CellKey(X, Y, Z);
+					const TArray<APortal*>* Cell = Cells.Find(CellKey);
+					if (Cell) {
+						Visit(CellKey, *Cell);
+					}
+				}
+			}
+		}
+		return;
+	}
+
+	for (auto& Cell : Cells) {
+		const FIntVector& CellKey = Cell.Key;
+		if (CellKey.X < MinCell.X || CellKey.Y < MinCell.Y || CellKey.Z < MinCell.Z || CellKey.X > MaxCell.X || CellKey.Y > MaxCell.Y || CellKey.Z > MaxCell.Z) {
+			continue;
+		}
+
+		Visit(CellKey, Cell.Value);
+	}
+}
+
+void FPortalRegistry::QuerySegment(const FVector& Start, const FVector& End, TArray<APortal*>& OutPortals) const {
+	QueryCounter += 1;
+
+	FIntVector StartCell = GetCell(Start);
+	FIntVector EndCell = GetCell(End);
+	FVector Delta = End - Start;
+
+	// Steps from cell to cell along the segment, always crossing the nearest cell boundary first
+	int32 Cell[3] = { StartCell.X, StartCell.Y, StartCell.Z };
+	int32 Step[3];
+	float NextTime[3];
+	float TimeStep[3];
+	for (int32 Axis = 0; Axis < 3; Axis++) {
+		if (Delta[Axis] > 0.0f) {
+			Step[Axis] = 1;
+			NextTime[Axis] = ((Cell[Axis] + 1) * CellSize - Start[Axis]) / Delta[Axis];
+			TimeStep[Axis] = CellSize / Delta[Axis];
+		} else if (Delta[Axis] < 0.0f) {
+			Step[Axis] = -1;
+			NextTime[Axis] = (Cell[Axis] * CellSize - Start[Axis]) / Delta[Axis];
+			TimeStep[Axis] = -CellSize / Delta[Axis];
+		} else {
+			Step[Axis] = 0;
+			NextTime[Axis] = MAX_FLT;
+			TimeStep[Axis] = MAX_FLT;
+		}
+	}
+
+	while (true) {
+		FIntVector CellKey(Cell[0], Cell[1], Cell[2]);
+		CollectCell(CellKey, OutPortals);
+
+		if (CellKey == EndCell) {
+			break;
+		}
+
+		int32 Axis = NextTime[0] < NextTime[1] ? (NextTime[0] < NextTime[2] ? 0 : 2) : (NextTime[1] < NextTime[2] ? 1 : 2);
+		if (NextTime[Axis] > 1.0f) {
+			break;
+		}
+
+		Cell[Axis] += Step[Axis];
+		NextTime[Axis] += TimeStep[Axis];
+	}
+}
+
+void FPortalRegistry::AddMover(AActor* Actor) {
+	for (const FMover& Mover : Movers) {
+		if (Mover.Actor.Get() == Actor) {
+			return;
+		}
+	}
+
+	Movers.Add({ Actor, Actor->GetActorLocation() });
+}
+
+void FPortalRegistry::RemoveMover(AActor* Actor) {
+	for (int32 Index = 0; Index < Movers.Num(); Index++) {
+		if (Movers[Index].Actor.Get() == Actor) {
+			Movers.RemoveAtSwap(Index, 1, false);
+			return;
+		}
+	}
+}
+
+void FPortalRegistry::ResetMover(AActor* Actor) {
+	for (FMover& Mover : Movers) {
+		if (Mover.Actor.Get() == Actor) {
+			Mover.PreviousLocation = Actor->GetActorLocation();
+			return;
+		}
+	}
+}
+
+void FPortalRegistry::UpdateMovers() {
+	if (LastMoversFrame == GFrameCounter) {
+		return;
+	}
+	LastMoversFrame = GFrameCounter;
+
+	PORTAL_SCOPE_CYCLE_COUNTER(UpdateMovers);
+
+	// Gather all paths first, as teleporting a mover must not change the paths of the others
+	MoverPaths.Reset();
+	for (int32 Index = Movers.Num() - 1; Index >= 0; Index--) {
+		FMover& Mover = Movers[Index];
+
+		AActor* Actor = Mover.Actor.Get();
+		if (!Actor) {
+			Movers.RemoveAtSwap(Index, 1, false);
+			continue;
+		}
+
+		FVector Location = Actor->GetActorLocation();
+		if (Location != Mover.PreviousLocation) {
+			MoverPaths.Add({ Actor, Mover.PreviousLocation, Location });
+		}
+
+		Mover.PreviousLocation = Location;
+	}
+
+	for (const FMoverPath& Path : MoverPaths) {
+		FBox PathBox(ForceInit);
+		PathBox += Path.Start;
+		PathBox += Path.End;
+
+		NearbyPortals.Reset();
+		QueryBox(PathBox, NearbyPortals);
+
+		// The first portal along the path is the one the mover went through
+		APortal* CrossedPortal = nullptr;
+		float CrossingTime = 1.0f;
+		for (APortal* Portal : NearbyPortals) {
+			float Time;
+			if (Portal->IntersectSegment(Path.Start, Path.End, Time) && Time <= CrossingTime) {
+				CrossedPortal = Portal;
+				CrossingTime = Time;
+			}
+		}
+
+		if (CrossedPortal) {
+			CrossedPortal->TeleportAtCrossing(Path.Actor, FMath::Lerp(Path.Start, Path.End, CrossingTime));
+		}
+	}
+}
+
+FBox FPortalRegistry::GetBounds() const {
+	if (bBoundsDirty) {
+		bBoundsDirty = false;
+		Bounds = FBox(ForceInit);
+		for (auto& Entry : Entries) {
+			Bounds += Entry.Value.Bounds;
+		}
+	}
+
+	return Bounds;
+}
+
+float FPortalRegistry::GetMaxDistance(const FVector& Location) const {
+	FBox PortalBounds = GetBounds();
+	if (!PortalBounds.IsValid) {
+		return 0.0f;
+	}
+
+	// The furthest corner is the one away from the location along every axis
+	FVector Center = PortalBounds.GetCenter();
+	FVector Corner(
+		Location.X < Center.X ? PortalBounds.Max.X : PortalBounds.Min.X,
+		Location.Y < Center.Y ? PortalBounds.Max.Y : PortalBounds.Min.Y,
+		Location.Z < Center.Z ? PortalBounds.Max.Z : PortalBounds.Min.Z);
+
+	return FVector::Dist(Location, Corner);
+}
+
+int32 FPortalRegistry::Num() const {
+	return Entries.Num();
+}
+
+FIntVector FPortalRegistry::GetCell(const FVector& Location) const {
+	return FIntVector(
+		FMath::FloorToInt(Location.X / CellSize),
+		FMath::FloorToInt(Location.Y / CellSize),
+		FMath::FloorToInt(Location.Z / CellSize));
+}
+
+void FPortalRegistry::CollectCell(const FIntVector& CellKey, TArray<APortal*>& OutPortals) const {
+	const TArray<APortal*>* Cell = Cells.Find(CellKey);
+	if (!Cell) {
+		return;
+	}
+
+	for (APortal* Portal : *Cell) {
+		const FEntry& Entry = Entries.FindChecked(Portal);
+		if (Entry.QueryStamp != QueryCounter) {
+			Entry.QueryStamp = QueryCounter;
+			OutPortals.Add(Portal);
+		}
+	}
+}
+
+void FPortalRegistry::CollectCellInVolume(const FIntVector& CellKey, const TArray<APortal*>& Cell, const FConvexVolume& Volume, TArray<APortal*>& OutPortals) const {
+	FVector HalfCell = FVector(CellSize * 0.5f);
+	FVector CellCenter = FVector(CellKey) * CellSize + HalfCell;
+	if (!Volume.IntersectBox(CellCenter, HalfCell)) {
+		return;
+	}
+
+	for (APortal* Portal : Cell) {
+		const FEntry& Entry = Entries.FindChecked(Portal);
+		if (Entry.QueryStamp == QueryCounter) {
+			continue;
+		}
+		Entry.QueryStamp = QueryCounter;
+
+		if (Volume.IntersectBox(Entry.Bounds.GetCenter(), Entry.Bounds.GetExtent())) {
+			OutPortals.Add(Portal);
+		}
+	}
+}
+
+void FPortalRegistry::AddToCells(APortal* Portal, const FEntry& Entry) {
+	for (int32 X = Entry.MinCell.X; X <= Entry.MaxCell.X; X++) {
+		for (int32 Y = Entry.MinCell.Y; Y <= Entry.MaxCell.Y; Y++) {
+			for (int32 Z = Entry.MinCell.Z; Z <= Entry.MaxCell.Z; Z++) {
+				Cells.FindOrAdd(FIntVector(X, Y, Z)).Add(Portal);
+			}
+		}
+	}
+}
+
+void FPortalRegistry::RemoveFromCells(APortal* Portal, const FEntry& Entry) {
+	for (int32 X = Entry.MinCell.X; X <= Entry.MaxCell.X; X++) {
+		for (int32 Y = Entry.MinCell.Y; Y <= Entry.MaxCell.Y; Y++) {
+			for (int32 Z = Entry.MinCell.Z; Z <= Entry.MaxCell.Z; Z++) {
+				FIntVector CellKey(X, Y, Z);
+				TArray<APortal*>* Cell = Cells.Find(CellKey);
+				if (!Cell) {
+					continue;
+				}
+
+				Cell->RemoveSwap(Portal);
+				if (Cell->Num() == 0) {
+					Cells.Remove(CellKey);
+				}
+			}
+		}
+	}
+}
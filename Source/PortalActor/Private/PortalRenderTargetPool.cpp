@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "PortalStats.h"
+#include "PortalRenderTargetPool.h"
+
+
+const uint32 FPortalRenderTargetPool::MaxFreeFrames = 120;
+
+static FAutoConsoleCommand PortalRenderTargetPoolCommand(
+	TEXT("Portal.RenderTargetPool"),
+	TEXT("Prints the state of the portal render target pool"),
+	FConsoleCommandDelegate::CreateLambda([]() {
+		auto& Pool = FPortalRenderTargetPool::Get();
+		UE_LOG(LogPortal, Display, TEXT("Portal render targets: %d, live: %lld KB, in use: %lld KB, peak: %lld KB"),
+			Pool.GetNumTargets(), Pool.GetLiveBytes() / 1024, Pool.GetInUseBytes() / 1024, Pool.GetPeakBytes() / 1024);
+	})
+);
+
+FPortalRenderTargetPool& FPortalRenderTargetPool::Get() {
+	static FPortalRenderTargetPool Pool;
+	return Pool;
+}
+
+UTextureRenderTarget2D* FPortalRenderTargetPool::Acquire(int32 SizeX, int32 SizeY, EPixelFormat Format) {
+	Trim();
+
+	FPoolKey Key = { FMath::Max(SizeX, 1), FMath::Max(SizeY, 1), Format };
+
+	UTextureRenderTarget2D* RenderTarget = nullptr;
+
+	TArray<FFreeTarget>* Free = FreeTargets.Find(Key);
+	if (Free && Free->Num() > 0) {
+		RenderTarget = Free->Pop(false).RenderTarget;
+	} else {
+		RenderTarget = NewObject<UTextureRenderTarget2D>(GetTransientPackage());
+		RenderTarget->InitCustomFormat(Key.SizeX, Key.SizeY, Key.Format, false);
+		RenderTarget->UpdateResourceImmediate(true);
+
+		Targets.Add(RenderTarget);
+		LiveBytes += GetTargetBytes(Key);
+		PeakBytes = FMath::Max(PeakBytes, LiveBytes);
+
+		INC_DWORD_STAT(STAT_PortalRenderTargets);
+		PORTAL_SET_MEMORY(RenderTargetMemory, LiveBytes);
+	}
+
+	InUseBytes += GetTargetBytes(Key);
+
+	return RenderTarget;
+}
+
+void FPortalRenderTargetPool::Release(UTextureRenderTarget2D* RenderTarget) {
+	if (!RenderTarget) {
+		return;
+	}
+
+	FPoolKey Key = MakeKey(RenderTarget);
+	FreeTargets.FindOrAdd(Key).Add({ RenderTarget, GFrameCounter });
+	InUseBytes -= GetTargetBytes(Key);
+}
+
+void FPortalRenderTargetPool::AddReferencedObjects(FReferenceCollector& Collector) {
+	for (UTextureRenderTarget2D*& RenderTarget : Targets) {
+		Collector.AddReferencedObject(RenderTarget);
+	}
+}
+
+FPortalRenderTargetPool::FPoolKey FPortalRenderTargetPool::MakeKey(const UTextureRenderTarget2D* RenderTarget) {
+	return { RenderTarget->SizeX, RenderTarget->SizeY, RenderTarget->OverrideFormat };
+}
+
+int64 FPortalRenderTargetPool::GetTargetBytes(const FPoolKey& Key) {
+	const FPixelFormatInfo& FormatInfo = GPixelFormats[Key.Format];
+	int64 BlocksX = FMath::DivideAndRoundUp(Key.SizeX, FormatInfo.BlockSizeX);
+	int64 BlocksY = FMath::DivideAndRoundUp(Key.SizeY, FormatInfo.BlockSizeY);
+
+	return BlocksX * BlocksY * FormatInfo.BlockBytes;
+}
+
+void FPortalRenderTargetPool::Trim() {
+	// Once per frame is enough
+	if (LastTrimFrame == GFrameCounter) {
+		return;
+	}
+	LastTrimFrame = GFrameCounter;
+
+	for (auto& Free : FreeTargets) {
+		for (int32 Index = Free.Value.Num() - 1; Index >= 0; Index--) {
+			FFreeTarget& FreeTarget = Free.Value[Index];
+			if (GFrameCounter - FreeTarget.ReleasedFrame < MaxFreeFrames) {
+				continue;
+			}
+
+			Targets.RemoveSwap(FreeTarget.RenderTarget);
+			FreeTarget.RenderTarget->ReleaseResource();
+			LiveBytes -= GetTargetBytes(Free.Key);
+
+			DEC_DWORD_STAT(STAT_PortalRenderTargets);
+			PORTAL_SET_MEMORY(RenderTargetMemory, LiveBytes);
+
+			Free.Value.RemoveAtSwap(Index, 1, false);
+		}
+	}
+}
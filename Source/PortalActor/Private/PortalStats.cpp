@@ -0,0 +1,86 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "PortalStats.h"
+
+
+DEFINE_LOG_CATEGORY(LogPortal);
+
+DEFINE_STAT(STAT_PortalTick);
+DEFINE_STAT(STAT_PortalUpdateCapture);
+DEFINE_STAT(STAT_PortalUpdatePortalsInSight);
+DEFINE_STAT(STAT_PortalRenderForPortal);
+DEFINE_STAT(STAT_PortalTeleport);
+DEFINE_STAT(STAT_PortalUpdateMovers);
+DEFINE_STAT(STAT_PortalGatherViews);
+DEFINE_STAT(STAT_PortalFlushCaptures);
+DEFINE_STAT(STAT_PortalUpdateGraph);
+DEFINE_STAT(STAT_PortalTrace);
+DEFINE_STAT(STAT_PortalProjectileBatch);
+DEFINE_STAT(STAT_PortalUpdateProxies);
+DEFINE_STAT(STAT_PortalCapturesRendered);
+DEFINE_STAT(STAT_PortalCapturesOverBudget);
+DEFINE_STAT(STAT_PortalCapturesNotDue);
+DEFINE_STAT(STAT_PortalTraces);
+DEFINE_STAT(STAT_PortalHiddenComponents);
+DEFINE_STAT(STAT_PortalTeleports);
+DEFINE_STAT(STAT_PortalTraceHops);
+DEFINE_STAT(STAT_PortalBatchedProjectiles);
+DEFINE_STAT(STAT_PortalProxies);
+DEFINE_STAT(STAT_PortalRenderTargets);
+DEFINE_STAT(STAT_PortalRenderTargetMemory);
+
+#if PORTAL_CSV_PROFILER
+CSV_DEFINE_CATEGORY(Portal, true);
+#endif
+
+FPortalTimings::FEntry FPortalTimings::Entries[(int32)EPortalTiming::Num] = {};
+
+double FPortalTimings::GetMilliseconds(EPortalTiming Timing) {
+	return Entries[(int32)Timing].Cycles * FPlatformTime::GetSecondsPerCycle() * 1000.0;
+}
+
+uint32 FPortalTimings::GetCalls(EPortalTiming Timing) {
+	return Entries[(int32)Timing].Calls;
+}
+
+const TCHAR* FPortalTimings::GetName(EPortalTiming Timing) {
+	switch (Timing) {
+		case EPortalTiming::UpdateCapture:
+			return TEXT("UpdateCapture");
+		case EPortalTiming::UpdatePortalsInSight:
+			return TEXT("UpdatePortalsInSight");
+		case EPortalTiming::RenderForPortal:
+			return TEXT("RenderForPortal");
+		case EPortalTiming::Teleport:
+			return TEXT("Teleport");
+		default:
+			return TEXT("Unknown");
+	}
+}
+
+void FPortalTimings::Reset() {
+	for (FEntry& Entry : Entries) {
+		Entry.Cycles = 0;
+		Entry.Calls = 0;
+	}
+}
+
+FPortalScopedTiming::FPortalScopedTiming(EPortalTiming InTiming): Timing(InTiming), StartCycles(0) {
+	FPortalTimings::FEntry& Entry = FPortalTimings::Entries[(int32)Timing];
+
+	Entry.ScopeDepth += 1;
+	if (Entry.ScopeDepth == 1) {
+		Entry.Calls += 1;
+		StartCycles = FPlatformTime::Cycles();
+	}
+}
+
+FPortalScopedTiming::~FPortalScopedTiming() {
+	FPortalTimings::FEntry& Entry = FPortalTimings::Entries[(int32)Timing];
+
+	Entry.ScopeDepth -= 1;
+	if (Entry.ScopeDepth == 0) {
+		Entry.Cycles += FPlatformTime::Cycles() - StartCycles;
+	}
+}
@@ -0,0 +1,112 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "Portal.h"
+#include "PortalRegistry.h"
+#include "PortalStats.h"
+#include "PortalTrace.h"
+
+
+bool FPortalTrace::LineTrace(UWorld* World, const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params, FPortalTraceResult& OutResult, int32 MaxHops) {
+	TArray<APortal*> NearbyPortals;
+	return Trace(World, Start, End, FQuat::Identity, Channel, FCollisionShape::LineShape, Params, OutResult, MaxHops, NearbyPortals);
+}
+
+bool FPortalTrace::Sweep(UWorld* World, const FVector& Start, const FVector& End, const FQuat& Rotation, ECollisionChannel Channel, const FCollisionShape& Shape, const FCollisionQueryParams& Params, FPortalTraceResult& OutResult, int32 MaxHops) {
+	TArray<APortal*> NearbyPortals;
+	return Trace(World, Start, End, Rotation, Channel, Shape, Params, OutResult, MaxHops, NearbyPortals);
+}
+
+void FPortalTrace::LineTraces(UWorld* World, const TArray<FPortalTraceRequest>& Requests, ECollisionChannel Channel, const FCollisionQueryParams& Params, TArray<FPortalTraceResult>& OutResults, int32 MaxHops) {
+	Sweeps(World, Requests, FQuat::Identity, Channel, FCollisionShape::LineShape, Params, OutResults, MaxHops);
+}
+
+void FPortalTrace::Sweeps(UWorld* World, const TArray<FPortalTraceRequest>& Requests, const FQuat& Rotation, ECollisionChannel Channel, const FCollisionShape& Shape, const FCollisionQueryParams& Params, TArray<FPortalTraceResult>& OutResults, int32 MaxHops) {
+	OutResults.Reset();
+	OutResults.SetNum(Requests.Num());
+
+	// Shared by every trace to avoid reallocating it for each one
+	TArray<APortal*> NearbyPortals;
+	for (int32 Index = 0; Index < Requests.Num(); Index++) {
+		Trace(World, Requests[Index].Start, Requests[Index].End, Rotation, Channel, Shape, Params, OutResults[Index], MaxHops, NearbyPortals);
+	}
+}
+
+bool FPortalTrace::Trace(UWorld* World, const FVector& Start, const FVector& End, const FQuat& Rotation, ECollisionChannel Channel, const FCollisionShape& Shape, const FCollisionQueryParams& Params, FPortalTraceResult& OutResult, int32 MaxHops, TArray<APortal*>& NearbyPortals) {
+	PORTAL_SCOPE_CYCLE_COUNTER(Trace);
+
+	OutResult.bBlockingHit = false;
+	OutResult.bHopLimitReached = false;
+	OutResult.Segments.Reset();
+
+	const FPortalRegistry& Registry = FPortalRegistry::Get(World);
+	bool bLine = Shape.IsNearlyZero();
+
+	FVector SegmentStart = Start;
+	FVector SegmentEnd = End;
+	FQuat SegmentRotation = Rotation;
+
+	// Portal the current segment comes out of, which it can't go back into
+	const APortal* ExitPortal = nullptr;
+
+	for (int32 Hop = 0; ; Hop++) {
+		NearbyPortals.Reset();
+		Registry.QuerySegment(SegmentStart, SegmentEnd, NearbyPortals);
+
+		// The first portal along the segment is the one it goes into
+		APortal* CrossedPortal = nullptr;
+		float CrossingTime = 1.0f;
+		for (APortal* Portal : NearbyPortals) {
+			float Time;
+			if (Portal != ExitPortal && Portal->GetTarget() && Portal->IntersectSegment(SegmentStart, SegmentEnd, Time) && Time <= CrossingTime) {
+				CrossedPortal = Portal;
+				CrossingTime = Time;
+			}
+		}
+
+		FVector CrossingLocation = CrossedPortal ? FMath::Lerp(SegmentStart, SegmentEnd, CrossingTime) : SegmentEnd;
+
+		// The mesh of the portal being crossed, and of the one just come out of, would block the trace
+		FCollisionQueryParams SegmentParams = Params;
+		if (CrossedPortal) {
+			SegmentParams.AddIgnoredActor(CrossedPortal);
+		}
+		if (ExitPortal) {
+			SegmentParams.AddIgnoredActor(ExitPortal);
+		}
+
+		FHitResult& Hit = OutResult.Hit;
+		bool bHit = bLine
+			? World->LineTraceSingleByChannel(Hit, SegmentStart, CrossingLocation, Channel, SegmentParams)
+			: World->SweepSingleByChannel(Hit, SegmentStart, CrossingLocation, SegmentRotation, Channel, Shape, SegmentParams);
+
+		if (bHit) {
+			OutResult.Segments.Add({ SegmentStart, Hit.Location, nullptr });
+			OutResult.bBlockingHit = true;
+			return true;
+		}
+
+		if (!CrossedPortal) {
+			OutResult.Segments.Add({ SegmentStart, CrossingLocation, nullptr });
+			return false;
+		}
+
+		OutResult.Segments.Add({ SegmentStart, CrossingLocation, CrossedPortal });
+
+		if (Hop == MaxHops) {
+			OutResult.bHopLimitReached = true;
+			return false;
+		}
+
+		PORTAL_INC_COUNTER(TraceHops, 1);
+
+		// Carry on from the Target with whatever length was left, turned the same way as anything going through
+		FTransform Exit = CrossedPortal->GetTeleportTransform(FTransform(SegmentRotation, CrossingLocation));
+		FQuat PortalRotation = Exit.GetRotation() * SegmentRotation.Inverse();
+
+		SegmentStart = Exit.GetLocation();
+		SegmentEnd = SegmentStart + PortalRotation.RotateVector(SegmentEnd - CrossingLocation);
+		SegmentRotation = Exit.GetRotation();
+		ExitPortal = CrossedPortal->GetTarget();
+	}
+}
@@ -0,0 +1,221 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "AutomationTest.h"
+#include "Camera/CameraActor.h"
+#include "Camera/CameraComponent.h"
+#include "PortalActorProjectile.h"
+#include "PortalRenderTargetPool.h"
+#include "PortalStats.h"
+#include "Portal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Scales the number of portal pairs and projectiles flying through them, and records how long the
+// portal entry points take per frame. Runs headless, e.g.:
+// UE4Editor-Cmd PortalActor -nullrhi -unattended -ExecCmds="Automation RunTests PortalActor.Benchmark; Quit"
+// Results are written as JSON to Saved/Automation/PortalBenchmark/.
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FPortalBenchmarkTest, "PortalActor.Benchmark", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::PerfFilter)
+
+namespace PortalBenchmark {
+	const int32 WarmupFrames = 30;
+	const int32 MeasuredFrames = 300;
+	const float FrameTime = 1.0f / 60.0f;
+
+	// Distance between two neighbouring portal pairs, far enough for them not to share grid cells
+	const float PairSpacing = 2000.0f;
+
+	struct FTimingSamples {
+		TArray<double> Milliseconds;
+		uint64 Calls = 0;
+	};
+
+	APortal* SpawnPortal(UWorld* World, UClass* PortalClass, const FTransform& Transform) {
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		SpawnParameters.bDeferConstruction = true;
+
+		return World->SpawnActor<APortal>(PortalClass, Transform, SpawnParameters);
+	}
+
+	// Two portals facing each other, so the captures of each one see the other
+	void SpawnPortalPair(UWorld* World, UClass* PortalClass, const FVector& Center, TArray<APortal*>& OutPortals) {
+		FTransform FirstTransform(FRotator(0, 0, 0), Center - FVector(500, 0, 0));
+		FTransform SecondTransform(FRotator(0, 180, 0), Center + FVector(500, 0, 0));
+
+		APortal* First = SpawnPortal(World, PortalClass, FirstTransform);
+		APortal* Second = SpawnPortal(World, PortalClass, SecondTransform);
+
+		First->SetTarget(Second);
+		Second->SetTarget(First);
+
+		First->FinishSpawning(FirstTransform);
+		Second->FinishSpawning(SecondTransform);
+
+		OutPortals.Add(First);
+		OutPortals.Add(Second);
+	}
+
+	// Captures are skipped for portals the renderer didn't draw lately, which it never does without a viewport
+	void MarkRendered(APortal* Portal) {
+		TInlineComponentArray<UStaticMeshComponent*> Meshes;
+		Portal->GetComponents(Meshes);
+
+		for (UStaticMeshComponent* Mesh : Meshes) {
+			Mesh->LastRenderTime = Portal->GetWorld()->GetTimeSeconds();
+		}
+	}
+
+	void SpawnProjectile(UWorld* World, FRandomStream& Random, const FVector& Center) {
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		// Aim at the opening of the first portal of the pair, with some spread
+		FVector Start = Center + FVector(Random.FRandRange(-200, 200), Random.FRandRange(-300, 300), Random.FRandRange(-100, 100));
+		FRotator Direction = (Center - FVector(500, 0, 0) - Start).Rotation();
+
+		World->SpawnActor<APortalActorProjectile>(APortalActorProjectile::StaticClass(), Start, Direction, SpawnParameters);
+	}
+
+	FString MakeReport(int32 NumPairs, int32 NumProjectiles, const FTimingSamples* Samples, double FrameMilliseconds) {
+		FString Report = FString::Printf(TEXT("{\n\t\"portalPairs\": %d,\n\t\"projectiles\": %d,\n\t\"frames\": %d,\n\t\"frameMs\": %.4f,\n"), NumPairs, NumProjectiles, MeasuredFrames, FrameMilliseconds);
+		Report += FString::Printf(TEXT("\t\"renderTargetBytes\": %lld,\n\t\"renderTargets\": %d,\n\t\"timings\": {\n"), FPortalRenderTargetPool::Get().GetPeakBytes(), FPortalRenderTargetPool::Get().GetNumTargets());
+
+		for (int32 Index = 0; Index < (int32)EPortalTiming::Num; Index++) {
+			TArray<double> Sorted = Samples[Index].Milliseconds;
+			Sorted.Sort();
+
+			double Total = 0.0;
+			for (double Milliseconds : Sorted) {
+				Total += Milliseconds;
+			}
+
+			double Mean = Sorted.Num() > 0 ? Total / Sorted.Num() : 0.0;
+			double Median = Sorted.Num() > 0 ? Sorted[Sorted.Num() / 2] : 0.0;
+			double Max = Sorted.Num() > 0 ? Sorted.Last() : 0.0;
+
+			Report += FString::Printf(TEXT("\t\t\"%s\": { \"meanMs\": %.4f, \"medianMs\": %.4f, \"maxMs\": %.4f, \"callsPerFrame\": %.2f }%s\n"),
+				FPortalTimings::GetName((EPortalTiming)Index), Mean, Median, Max, (double)Samples[Index].Calls / MeasuredFrames,
+				Index + 1 < (int32)EPortalTiming::Num ? TEXT(",") : TEXT(""));
+		}
+
+		Report += TEXT("\t}\n}\n");
+		return Report;
+	}
+}
+
+void FPortalBenchmarkTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const {
+	const int32 PairCounts[] = { 1, 4, 16, 64 };
+	const int32 ProjectileCounts[] = { 0, 100, 1000 };
+
+	for (int32 NumPairs : PairCounts) {
+		for (int32 NumProjectiles : ProjectileCounts) {
+			OutBeautifiedNames.Add(FString::Printf(TEXT("%d pairs, %d projectiles"), NumPairs, NumProjectiles));
+			OutTestCommands.Add(FString::Printf(TEXT("%d %d"), NumPairs, NumProjectiles));
+		}
+	}
+}
+
+bool FPortalBenchmarkTest::RunTest(const FString& Parameters) {
+	using namespace PortalBenchmark;
+
+	FString PairsParameter;
+	FString ProjectilesParameter;
+	if (!Parameters.Split(TEXT(" "), &PairsParameter, &ProjectilesParameter)) {
+		AddError(FString::Printf(TEXT("Invalid parameters: %s"), *Parameters));
+		return false;
+	}
+
+	int32 NumPairs = FCString::Atoi(*PairsParameter);
+	int32 NumProjectiles = FCString::Atoi(*ProjectilesParameter);
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	// The blueprint provides the meshes and material, fall back to the bare class without content
+	UClass* PortalClass = StaticLoadClass(APortal::StaticClass(), nullptr, TEXT("/Game/PortalActor/BP_Portal.BP_Portal_C"));
+	bool bCanCapture = PortalClass != nullptr;
+	if (!PortalClass) {
+		AddWarning(TEXT("BP_Portal not found, benchmarking the native portal class, which has no material to capture for"));
+		PortalClass = APortal::StaticClass();
+	}
+
+	// Pairs are laid out along Y, the camera looks at them from the side of their first portals
+	TArray<FVector> PairCenters;
+	TArray<APortal*> Portals;
+	for (int32 Index = 0; Index < NumPairs; Index++) {
+		PairCenters.Add(FVector(0, Index * PairSpacing, 0));
+		SpawnPortalPair(World, PortalClass, PairCenters.Last(), Portals);
+	}
+
+	APlayerController* PlayerController = World->SpawnActor<APlayerController>();
+	FVector CameraLocation(-2000, (NumPairs - 1) * PairSpacing * 0.5f, 100);
+	FRotator CameraRotation = FRotator(0, 0, 0);
+	// The camera manager refreshes its view from the view target every frame, so the view comes from a camera actor
+	ACameraActor* Camera = World->SpawnActor<ACameraActor>(CameraLocation, CameraRotation);
+	if (PlayerController && Camera) {
+		Camera->GetCameraComponent()->SetFieldOfView(90.0f);
+		PlayerController->SetViewTarget(Camera);
+	}
+
+	// Same projectile spread on every run, so results stay comparable
+	FRandomStream Random(NumPairs * 10000 + NumProjectiles);
+	FTimingSamples Samples[(int32)EPortalTiming::Num];
+	double MeasuredSeconds = 0.0;
+
+	for (int32 Frame = 0; Frame < WarmupFrames + MeasuredFrames; Frame++) {
+		// Keep the projectile count steady as they expire or get destroyed on hits
+		int32 NumAlive = 0;
+		for (TActorIterator<APortalActorProjectile> It(World); It; ++It) {
+			NumAlive += It->IsPendingKill() ? 0 : 1;
+		}
+		for (int32 Index = NumAlive; Index < NumProjectiles && NumPairs > 0; Index++) {
+			SpawnProjectile(World, Random, PairCenters[Index % NumPairs]);
+		}
+
+		for (APortal* Portal : Portals) {
+			MarkRendered(Portal);
+		}
+
+		// The engine loop isn't running, the per-frame guards of the portal code rely on the frame counter
+		GFrameCounter += 1;
+		FPortalTimings::Reset();
+
+		double StartSeconds = FPlatformTime::Seconds();
+		World->Tick(LEVELTICK_All, FrameTime);
+		double FrameSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+		if (Frame < WarmupFrames) {
+			continue;
+		}
+
+		MeasuredSeconds += FrameSeconds;
+		for (int32 Index = 0; Index < (int32)EPortalTiming::Num; Index++) {
+			Samples[Index].Milliseconds.Add(FPortalTimings::GetMilliseconds((EPortalTiming)Index));
+			Samples[Index].Calls += FPortalTimings::GetCalls((EPortalTiming)Index);
+		}
+	}
+
+	FString Report = MakeReport(NumPairs, NumProjectiles, Samples, MeasuredSeconds * 1000.0 / MeasuredFrames);
+	FString ReportPath = FPaths::Combine(FPaths::AutomationDir(), TEXT("PortalBenchmark"), FString::Printf(TEXT("Pairs%d_Projectiles%d.json"), NumPairs, NumProjectiles));
+	if (!FFileHelper::SaveStringToFile(Report, *ReportPath)) {
+		AddWarning(FString::Printf(TEXT("Could not write %s"), *ReportPath));
+	}
+	AddLogItem(Report);
+
+	// A report of idle entry points would look like a fast one
+	if (bCanCapture && NumPairs > 0 && Samples[(int32)EPortalTiming::UpdateCapture].Calls == 0) {
+		AddError(TEXT("No portal captured, the capture timings measured nothing"));
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "AutomationTest.h"
+#include "Portal.h"
+#include "PortalActorCharacter.h"
+#include "PortalCharacterMovementComponent.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Plays both ends of a character going through a portal with the client and the server a few moves apart, in one
+// world without a session. As the server, a client position on the other side of the portal is forgiven until the
+// grace time runs out. As the owning client, the teleport sent by the server carries the saved moves through the
+// portal, and a correction from before the crossing is replayed from the other side.
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalTeleportCorrectionTest, "PortalActor.Network.TeleportCorrection", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::EngineFilter)
+
+namespace PortalTeleportCorrectionTest {
+	const float FrameTime = 1.0f / 60.0f;
+
+	// Longer than the default grace time of the movement component
+	const int32 GraceFrames = 60;
+
+	const int32 NumMoves = 3;
+	const float MoveTimeStamps[NumMoves] = { 1.0f, 1.1f, 1.2f };
+
+	APortal* SpawnPortal(UWorld* World, const FTransform& Transform) {
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		SpawnParameters.bDeferConstruction = true;
+
+		return World->SpawnActor<APortal>(APortal::StaticClass(), Transform, SpawnParameters);
+	}
+
+	// What the server's movement would ask the client to check for the character at ClientLoc
+	bool CheckClientError(UPortalCharacterMovementComponent* Movement, const FVector& ClientLoc) {
+		return Movement->ServerCheckClientError(MoveTimeStamps[0], FrameTime, FVector::ZeroVector, ClientLoc, ClientLoc, nullptr, NAME_None, Movement->PackNetworkMovementMode());
+	}
+
+	void Correct(UPortalCharacterMovementComponent* Movement, float TimeStamp, const FVector& ServerLoc) {
+		Movement->ClientAdjustPosition_Implementation(TimeStamp, ServerLoc, FVector::ZeroVector, nullptr, NAME_None, false, false, Movement->PackNetworkMovementMode());
+	}
+}
+
+bool FPortalTeleportCorrectionTest::RunTest(const FString& Parameters) {
+	using namespace PortalTeleportCorrectionTest;
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	FTransform FirstTransform(FRotator(0, 0, 0), FVector(-500, 0, 0));
+	FTransform SecondTransform(FRotator(0, 90, 0), FVector(500, 1000, 0));
+	APortal* First = SpawnPortal(World, FirstTransform);
+	APortal* Second = SpawnPortal(World, SecondTransform);
+	First->SetTarget(Second);
+	Second->SetTarget(First);
+	First->FinishSpawning(FirstTransform);
+	Second->FinishSpawning(SecondTransform);
+
+	// Just in front of the first portal, and where that comes out of the second one
+	FVector EntryLoc = First->GetActorLocation() + First->GetActorForwardVector() * 50.0f;
+	FVector ExitLoc = First->GetTeleportTransform(FTransform(EntryLoc)).GetLocation();
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	APortalActorCharacter* Character = World->SpawnActor<APortalActorCharacter>(APortalActorCharacter::StaticClass(), EntryLoc, FRotator::ZeroRotator, SpawnParameters);
+	auto Movement = Character ? Cast<UPortalCharacterMovementComponent>(Character->GetCharacterMovement()) : nullptr;
+	TestTrue(TEXT("Character has the portal movement"), Movement != nullptr);
+
+	if (Movement) {
+		// Teleports only happen when the test says so, and the character stays put while the world ticks
+		Character->SetActorEnableCollision(false);
+		Movement->SetMovementMode(MOVE_Flying);
+
+		// Server: the client went through, the server not yet
+		TestFalse(TEXT("Server forgives a client on the other side of the portal"), CheckClientError(Movement, ExitLoc));
+		TestEqual(TEXT("Forgiven errors"), (int32)Movement->GetNumForgivenErrors(), 1);
+		TestTrue(TEXT("Server corrects a client elsewhere"), CheckClientError(Movement, EntryLoc + FVector(0, 0, 1000)));
+
+		TestFalse(TEXT("Server forgives the client again"), CheckClientError(Movement, ExitLoc));
+		for (int32 Frame = 0; Frame < GraceFrames; Frame++) {
+			GFrameCounter += 1;
+			World->Tick(LEVELTICK_All, FrameTime);
+		}
+		Character->SetActorLocation(EntryLoc);
+		TestTrue(TEXT("Server corrects the client once the grace time is over"), CheckClientError(Movement, ExitLoc));
+
+		// Client: moves walking into the portal still wait on the server when its teleport arrives
+		Character->Role = ROLE_AutonomousProxy;
+		First->Role = ROLE_SimulatedProxy;
+		Second->Role = ROLE_SimulatedProxy;
+
+		FVector Acceleration = -First->GetActorForwardVector() * Movement->GetMaxAcceleration();
+		auto ClientData = Movement->GetPredictionData_Client_Character();
+		TArray<FVector> MoveLocations;
+		for (int32 Index = 0; Index < NumMoves; Index++) {
+			FSavedMovePtr Move = MakeShareable(new FSavedMove_Character());
+			Move->TimeStamp = MoveTimeStamps[Index];
+			Move->DeltaTime = FrameTime;
+			Move->StartLocation = EntryLoc - First->GetActorForwardVector() * Index * 10.0f;
+			Move->SavedLocation = EntryLoc - First->GetActorForwardVector() * (Index + 1) * 10.0f;
+			Move->Acceleration = Acceleration;
+			ClientData->SavedMoves.Add(Move);
+
+			MoveLocations.Add(Move->SavedLocation);
+		}
+
+		Character->SetActorLocation(MoveLocations.Last());
+		FVector TeleportedLoc = First->GetTeleportTransform(FTransform(MoveLocations.Last())).GetLocation();
+		First->MulticastTeleport_Implementation(Character, Second->GetActorTransform().InverseTransformPosition(TeleportedLoc));
+
+		TestTrue(TEXT("Client went through the portal"), Character->GetActorLocation().Equals(TeleportedLoc, 1.0f));
+		TestTrue(TEXT("Client knows it went through"), Movement->HasRecentTeleport(First));
+
+		for (int32 Index = 0; Index < MoveLocations.Num(); Index++) {
+			FVector Expected = First->GetTeleportTransform(FTransform(MoveLocations[Index])).GetLocation();
+			TestTrue(FString::Printf(TEXT("Saved move %d went through the portal"), Index), ClientData->SavedMoves[Index]->SavedLocation.Equals(Expected, 0.1f));
+		}
+		TestTrue(TEXT("Saved acceleration went through the portal"), ClientData->SavedMoves[0]->Acceleration.Equals(First->GetTeleportDirection(Acceleration), 0.1f));
+
+		// The server corrects the first move, from before it went through itself
+		FVector ServerLoc = MoveLocations[0] + FVector(0, 0, 20);
+		Correct(Movement, MoveTimeStamps[0], ServerLoc);
+		FVector CarriedLoc = First->GetTeleportTransform(FTransform(ServerLoc)).GetLocation();
+		TestTrue(FString::Printf(TEXT("Correction before the crossing is replayed from the other side (%s, expected %s)"), *Character->GetActorLocation().ToString(), *CarriedLoc.ToString()), Character->GetActorLocation().Equals(CarriedLoc, 0.1f));
+		TestEqual(TEXT("Carried corrections"), (int32)Movement->GetNumCarriedCorrections(), 1);
+
+		// Then the second one, once it went through as well
+		ServerLoc = First->GetTeleportTransform(FTransform(MoveLocations[1])).GetLocation() + FVector(0, 0, 20);
+		Correct(Movement, MoveTimeStamps[1], ServerLoc);
+		TestTrue(TEXT("Correction after the crossing is applied as is"), Character->GetActorLocation().Equals(ServerLoc, 0.1f));
+		TestEqual(TEXT("Carried corrections after the crossing"), (int32)Movement->GetNumCarriedCorrections(), 1);
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,124 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "AutomationTest.h"
+#include "PortalActorProjectile.h"
+#include "PortalActorProjectilePool.h"
+#include "PortalManager.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Compares firing projectiles by spawning and destroying them with firing them from the projectile pool, and finding the
+// pool for each shot by scanning the world with keeping a pointer to it.
+// Results are written as JSON to Saved/Automation/PortalBenchmark/ProjectileSpawn.json.
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalProjectileSpawnBenchmarkTest, "PortalActor.Benchmark.ProjectileSpawn", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::PerfFilter)
+
+namespace PortalProjectileSpawnBenchmark {
+	const int32 NumShots = 1000;
+
+	// Far apart enough for the projectiles not to collide with each other
+	FVector GetShotLocation(int32 Index) {
+		return FVector((Index % 32) * 50.0f, (Index / 32) * 50.0f, 1000.0f);
+	}
+}
+
+bool FPortalProjectileSpawnBenchmarkTest::RunTest(const FString& Parameters) {
+	using namespace PortalProjectileSpawnBenchmark;
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	// Before: a new actor for every shot, destroyed when it hits or expires, then garbage collected
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+
+	TArray<APortalActorProjectile*> Spawned;
+	double StartSeconds = FPlatformTime::Seconds();
+	for (int32 Index = 0; Index < NumShots; Index++) {
+		Spawned.Add(World->SpawnActor<APortalActorProjectile>(APortalActorProjectile::StaticClass(), GetShotLocation(Index), FRotator::ZeroRotator, SpawnParameters));
+	}
+	double SpawnSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	StartSeconds = FPlatformTime::Seconds();
+	for (APortalActorProjectile* Projectile : Spawned) {
+		if (Projectile) {
+			Projectile->Destroy();
+		}
+	}
+	double DestroySeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	StartSeconds = FPlatformTime::Seconds();
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	double GarbageSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	// After: the pool is prewarmed, shots only move, show and hide existing projectiles
+	APortalActorProjectilePool* Pool = APortalActorProjectilePool::Get(World, APortalActorProjectile::StaticClass());
+	StartSeconds = FPlatformTime::Seconds();
+	Pool->Prewarm(NumShots);
+	double PrewarmSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	TArray<APortalActorProjectile*> Acquired;
+	StartSeconds = FPlatformTime::Seconds();
+	for (int32 Index = 0; Index < NumShots; Index++) {
+		Acquired.Add(Pool->Acquire(GetShotLocation(Index), FRotator::ZeroRotator));
+	}
+	double AcquireSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	StartSeconds = FPlatformTime::Seconds();
+	for (APortalActorProjectile* Projectile : Acquired) {
+		if (Projectile) {
+			Projectile->Recycle();
+		}
+	}
+	double ReleaseSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	// Finding the pool and the manager for a shot, by scanning the world's actors as every shot used to, and through the
+	// pointers the character and the pool now keep from BeginPlay. The pooled projectiles are in the world, so the scans
+	// walk as many actors as they would during play
+	APortalManager::Get(World);
+
+	int32 NumFound = 0;
+	StartSeconds = FPlatformTime::Seconds();
+	for (int32 Index = 0; Index < NumShots; Index++) {
+		if (APortalActorProjectilePool::Get(World, APortalActorProjectile::StaticClass()) && APortalManager::Find(World)) {
+			NumFound++;
+		}
+	}
+	double ScanSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	TWeakObjectPtr<APortalActorProjectilePool> CachedPool = Pool;
+	TWeakObjectPtr<APortalManager> CachedManager = APortalManager::Find(World);
+	StartSeconds = FPlatformTime::Seconds();
+	for (int32 Index = 0; Index < NumShots; Index++) {
+		if (CachedPool.IsValid() && CachedManager.IsValid()) {
+			NumFound++;
+		}
+	}
+	double CachedSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	TestEqual(TEXT("Pool and manager found for every shot"), NumFound, NumShots * 2);
+	TestEqual(TEXT("Pool size after firing every pooled projectile"), Pool->GetNumProjectiles(), NumShots);
+	TestEqual(TEXT("Free projectiles after recycling them"), Pool->GetNumFree(), NumShots);
+
+	auto PerShot = [](double Seconds) { return Seconds * 1000000.0 / NumShots; };
+	FString Report = FString::Printf(TEXT("{\n\t\"shots\": %d,\n\t\"spawn\": { \"spawnUs\": %.3f, \"destroyUs\": %.3f, \"garbageCollectionUs\": %.3f },\n\t\"pool\": { \"prewarmUs\": %.3f, \"acquireUs\": %.3f, \"releaseUs\": %.3f },\n\t\"lookup\": { \"scanUs\": %.3f, \"cachedUs\": %.3f }\n}\n"),
+		NumShots, PerShot(SpawnSeconds), PerShot(DestroySeconds), PerShot(GarbageSeconds), PerShot(PrewarmSeconds), PerShot(AcquireSeconds), PerShot(ReleaseSeconds),
+		PerShot(ScanSeconds), PerShot(CachedSeconds));
+
+	FString ReportPath = FPaths::Combine(FPaths::AutomationDir(), TEXT("PortalBenchmark"), TEXT("ProjectileSpawn.json"));
+	if (!FFileHelper::SaveStringToFile(Report, *ReportPath)) {
+		AddWarning(FString::Printf(TEXT("Could not write %s"), *ReportPath));
+	}
+	AddLogItem(Report);
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,122 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PortalActor.h"
+#include "AutomationTest.h"
+#include "Camera/CameraActor.h"
+#include "Camera/CameraComponent.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "StereoRendering.h"
+#include "Portal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Looks at a portal pair in stereo and checks each eye gets its own capture. Needs a stereo device, without an HMD run with
+// UE4Editor-Cmd PortalActor -emulatestereo -unattended -ExecCmds="Automation RunTests PortalActor.Stereo; Quit"
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalStereoTest, "PortalActor.Stereo.EyeCaptures", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::EngineFilter)
+
+namespace PortalStereoTest {
+	const int32 Frames = 10;
+	const float FrameTime = 1.0f / 60.0f;
+
+	APortal* SpawnPortal(UWorld* World, UClass* PortalClass, const FTransform& Transform) {
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		SpawnParameters.bDeferConstruction = true;
+
+		return World->SpawnActor<APortal>(PortalClass, Transform, SpawnParameters);
+	}
+
+	// Captures are skipped for portals the renderer didn't draw lately, which it never does without a viewport
+	void MarkRendered(APortal* Portal) {
+		TInlineComponentArray<UStaticMeshComponent*> Meshes;
+		Portal->GetComponents(Meshes);
+
+		for (UStaticMeshComponent* Mesh : Meshes) {
+			Mesh->LastRenderTime = Portal->GetWorld()->GetTimeSeconds();
+		}
+	}
+}
+
+bool FPortalStereoTest::RunTest(const FString& Parameters) {
+	using namespace PortalStereoTest;
+
+	auto StereoDevice = GEngine->StereoRenderingDevice;
+	if (!StereoDevice.IsValid()) {
+		AddWarning(TEXT("No stereo device, run with -emulatestereo"));
+		return true;
+	}
+
+	// Eye captures need the portal material, which only the blueprint provides
+	UClass* PortalClass = StaticLoadClass(APortal::StaticClass(), nullptr, TEXT("/Game/PortalActor/BP_Portal.BP_Portal_C"));
+	if (!PortalClass) {
+		AddWarning(TEXT("BP_Portal not found"));
+		return true;
+	}
+
+	bool bWasStereoEnabled = StereoDevice->IsStereoEnabled();
+	StereoDevice->EnableStereo(true);
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	FTransform FirstTransform(FRotator(0, 0, 0), FVector(-500, 0, 0));
+	FTransform SecondTransform(FRotator(0, 180, 0), FVector(500, 0, 0));
+	APortal* First = SpawnPortal(World, PortalClass, FirstTransform);
+	APortal* Second = SpawnPortal(World, PortalClass, SecondTransform);
+	First->SetTarget(Second);
+	Second->SetTarget(First);
+	First->FinishSpawning(FirstTransform);
+	Second->FinishSpawning(SecondTransform);
+
+	// In front of the first portal, looking into it
+	APlayerController* PlayerController = World->SpawnActor<APlayerController>();
+	ACameraActor* Camera = World->SpawnActor<ACameraActor>(FVector(-1000, 0, 0), FRotator(0, 0, 0));
+	Camera->GetCameraComponent()->SetFieldOfView(90.0f);
+	PlayerController->SetViewTarget(Camera);
+
+	for (int32 Frame = 0; Frame < Frames; Frame++) {
+		MarkRendered(First);
+		MarkRendered(Second);
+
+		// The engine loop isn't running, the per-frame guards of the portal code rely on the frame counter
+		GFrameCounter += 1;
+		World->Tick(LEVELTICK_All, FrameTime);
+	}
+
+	// Without TargetRight in the material the portal captures once from between the eyes, there is nothing per eye to check
+	if (!First->SupportsStereo()) {
+		AddWarning(TEXT("The portal material has no TargetRight parameter, portals capture in mono"));
+	} else {
+		USceneCaptureComponent2D* LeftCapture = First->GetCaptureComponent();
+		USceneCaptureComponent2D* RightCapture = First->GetRightCaptureComponent();
+		TestTrue(TEXT("Right eye has a capture"), RightCapture != nullptr);
+
+		if (LeftCapture && RightCapture) {
+			UTextureRenderTarget2D* LeftTarget = LeftCapture->TextureTarget;
+			UTextureRenderTarget2D* RightTarget = RightCapture->TextureTarget;
+			TestTrue(TEXT("Both eyes have a render target"), LeftTarget && RightTarget);
+			TestTrue(TEXT("Eyes render to their own targets"), LeftTarget != RightTarget);
+
+			if (LeftTarget && RightTarget) {
+				TestEqual(TEXT("Eye targets have the same width"), LeftTarget->SizeX, RightTarget->SizeX);
+				TestEqual(TEXT("Eye targets have the same height"), LeftTarget->SizeY, RightTarget->SizeY);
+			}
+
+			float EyeSeparation = FVector::Dist(LeftCapture->GetComponentLocation(), RightCapture->GetComponentLocation());
+			TestTrue(FString::Printf(TEXT("Eye captures are apart (%.2f)"), EyeSeparation), EyeSeparation > KINDA_SMALL_NUMBER);
+		}
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	StereoDevice->EnableStereo(bWasStereoEnabled);
+
+	return true;
+}
+
+#endif
@@ -3,9 +3,153 @@
 #pragma once
 
 #include "GameFramework/Actor.h"
+#include "WorldCollision.h"
+#include "PortalCooldownTable.h"
+#include "PortalHiddenSet.h"
 #include "Portal.generated.h"
 
+class APortal;
+class APlayerController;
 class UArrowComponent;
+class UNavLinkCustomComponent;
+class UTextureRenderTarget2D;
+
+// How captures get rid of the geometry between them and the portal they look out of
+UENUM()
+enum class EPortalClipMode: uint8 {
+	// Clip plane of the capture. Needs r.AllowGlobalClipPlane, which adds cost to every base pass draw of the game
+	GlobalClipPlane,
+
+	// Projection matrix whose near plane is aligned to the portal, only affects the capture itself
+	ObliqueNearPlane
+};
+
+// Scene capture together with the mesh and material displaying its image
+USTRUCT()
+struct FPortalCaptureSlot {
+	GENERATED_BODY()
+
+	UPROPERTY()
+	USceneCaptureComponent2D* Capture = nullptr;
+
+	UPROPERTY()
+	UStaticMeshComponent* Mesh = nullptr;
+
+	UPROPERTY()
+	UMaterialInstanceDynamic* Material = nullptr;
+
+	// Borrowed from the render target pool while the capture is in use
+	UPROPERTY()
+	UTextureRenderTarget2D* RenderTarget = nullptr;
+
+	uint64 LastUsedFrame = 0;
+
+	// Render target size as a power of two fraction of the viewport, 0 being full size
+	int32 ResolutionTier = 0;
+
+	// Set when a new render target was bound, which has to be captured regardless of the schedule
+	bool bNeedsCapture = false;
+
+	// Portal components the capture must not render. Heap allocated so it stays put when the slot moves
+	TSharedPtr<FPortalHiddenSet> HiddenSet;
+
+	// In stereo, Capture and RenderTarget render the left eye and these the right one
+	UPROPERTY()
+	USceneCaptureComponent2D* RightCapture = nullptr;
+
+	UPROPERTY()
+	UTextureRenderTarget2D* RightRenderTarget = nullptr;
+
+	TSharedPtr<FPortalHiddenSet> RightHiddenSet;
+	bool bStereo = false;
+};
+
+// A capture looking through a portal, which may itself see other portals
+struct FPortalView {
+	// Portal the capture looks through
+	const APortal* Portal;
+	USceneCaptureComponent2D* Capture;
+	FPortalHiddenSet* HiddenSet;
+
+	// Fraction of the player's view size the capture renders at
+	float ResolutionScale;
+
+	// Size of the player's view the chain of captures started from
+	FIntPoint ViewSize;
+
+	// 0 for the player's view through a portal, one more for every portal seen inside it
+	int32 Depth;
+};
+
+// A local player looking at the portal, and the capture it needs through it
+struct FPortalPlayerView {
+	APlayerController* PlayerController;
+
+	// Size of a single eye's view in stereo
+	FIntPoint ViewSize;
+
+	// From the center of the eyes in stereo, for materials which can only show one image to both
+	FTransform CaptureTransform;
+
+	// Eye captures in stereo
+	FTransform LeftCaptureTransform;
+	FTransform RightCaptureTransform;
+	bool bStereo;
+
+	float ResolutionScale;
+	float Distance;
+
+	// Players whose captures would be nearly identical share the capture of the group's leader
+	int32 Group;
+	bool bLeader;
+};
+
+// Mapping from a portal to its target, composed once and reused until either portal moves
+struct FPortalPairTransform {
+	// Moves views (and directions) to the other side
+	FMatrix CaptureMatrix;
+
+	// Moves teleported actors to the other side
+	FMatrix TeleportMatrix;
+
+	// Rotation added to anything going through
+	FQuat Rotation;
+
+	const APortal* Target = nullptr;
+	uint32 SourceVersion = 0;
+	uint32 TargetVersion = 0;
+};
+
+// Whether a capture can see a portal, from an async trace issued the frame before
+struct FPortalSightTrace {
+	TWeakObjectPtr<const USceneCaptureComponent2D> Capture;
+	TWeakObjectPtr<const APortal> VisiblePortal;
+
+	FTraceHandle Handle;
+	uint64 IssuedFrame = 0;
+
+	// Last frame the capture asked for the result
+	uint64 RequestedFrame = 0;
+
+	bool bHasResult = false;
+	bool bInSight = false;
+};
+
+// Plane and opening of a portal, copied out so segments can be tested against it without touching the portal
+struct FPortalOpening {
+	// Point on the portal plane, and its normal pointing out of the front
+	FVector Location;
+	FVector Normal;
+
+	// Center and axes of the opening, and its half size along them
+	FVector Center;
+	FVector AxisY;
+	FVector AxisZ;
+	FVector2D Extent;
+
+	// Whether the segment goes in through the opening from the front, and where along it, from 0 to 1
+	bool IntersectSegment(const FVector& Start, const FVector& End, float& OutTime) const;
+};
 
 UCLASS()
 class PORTALACTOR_API APortal: public AActor {
@@ -15,18 +159,55 @@ public:
 	// Sets default values for this actor's properties
 	APortal();
 
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
+	APortal* GetTarget() const;
+
+	// Teleports, navigation and the portal graph follow right away, rendering only when set before the portal begins play
+	void SetTarget(APortal* NewTarget);
+
+	// Where walking into the portal starts, on the floor in front of it
+	FVector GetEntryLocation() const;
+
+	// Where the entry location comes out of the Target
+	FVector GetExitLocation() const;
 
 	USceneCaptureComponent2D* GetCaptureComponent() const;
-	TArray<UPrimitiveComponent*> GetPortalComponents(const APortal* Requester) const;
 
-	void UpdatePortalsInSight(const APortal* Requester) const;
-	UStaticMeshComponent* RenderForPortal(const APortal* Requester);
+	// Right eye capture of the main slot, only created in stereo
+	USceneCaptureComponent2D* GetRightCaptureComponent() const;
+
+	// Whether PortalMaterial can show each eye its own capture
+	bool SupportsStereo() const;
+	FBox GetPortalBounds() const;
+
+	// Hides the meshes of this portal from a capture, except the one showing the image made for that capture
+	void HidePortalComponents(FPortalHiddenSet& HiddenSet, const UPrimitiveComponent* VisibleMesh) const;
+
+	FTransform GetTeleportTransform(const FTransform& ActorTransform, bool bCaptureTransform = false) const;
+
+	// Same as GetTeleportTransform, for many transforms at once
+	void GetTeleportTransforms(const TArray<FTransform>& ActorTransforms, TArray<FTransform>& OutTransforms, bool bCaptureTransform = false) const;
+
+	// Turns a velocity or direction the way it comes out of the Target
+	FVector GetTeleportDirection(const FVector& Direction) const;
+
+	// Whether the segment goes in through the portal's opening, and where along it, from 0 to 1
+	bool IntersectSegment(const FVector& Start, const FVector& End, float& OutTime) const;
+
+	FPortalOpening GetOpening() const;
+
+	// Actors overlapping the opening, which are partly on either side of the portal
+	void GetStraddlingActors(TArray<AActor*>& OutActors) const;
+
+	// Teleports an actor which travelled through the portal without necessarily overlapping it
+	void TeleportAtCrossing(AActor* Actor, const FVector& CrossingLocation);
+
+	void UpdatePortalsInSight(const FPortalView& View) const;
+	UStaticMeshComponent* RenderForPortal(const FPortalView& RequesterView);
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 private:
 	UPROPERTY(EditDefaultsOnly, Category = "Portal")
@@ -50,27 +231,139 @@ private:
 	UPROPERTY(EditAnywhere, Category = "Portal")
 	APortal* Target = nullptr;
 
+	// Number of frames a capture may stay unused before its render target goes back to the pool
+	UPROPERTY(EditAnywhere, Category = "Portal")
+	int32 IdleFramesBeforeRelease = 2;
+
+	// Lowest resolution tier captures may drop to, each tier halving the render target size
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0", ClampMax = "4"))
+	int32 MaxResolutionTier = 3;
+
+	// How far below a tier's size the portal must shrink on screen before the capture drops to it
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0.0", ClampMax = "0.5"))
+	float ResolutionHysteresis = 0.15f;
+
+	UPROPERTY(EditAnywhere, Category = "Portal")
+	EPortalClipMode ClipMode = EPortalClipMode::ObliqueNearPlane;
+
+	// Seconds the portal may go unrendered before it is treated as occluded and stops capturing
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0.0"))
+	float OcclusionTolerance = 0.1f;
+
+	// Splitscreen players whose virtual cameras through the portal are closer than this share one capture
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0.0"))
+	float SharedCaptureDistance = 20.0f;
+
+	// Largest angle in degrees between the virtual cameras of players sharing a capture
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0.0"))
+	float SharedCaptureAngle = 2.0f;
+
+	// Most captures kept for views looking at this portal. The least recently used ones get destroyed past that
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0"))
+	int32 MaxRequesterSlots = 8;
+
 	USceneCaptureComponent2D* TargetCapture = nullptr;
-	UMaterialInstanceDynamic* MakeRenderMaterial(USceneCaptureComponent2D* CaptureToUse);
+	UMaterialInstanceDynamic* MakeRenderMaterial();
+
+	float GetTierScale(int32 Tier) const;
+	int32 SelectResolutionTier(int32 CurrentTier, float ResolutionScale) const;
+	USceneCaptureComponent2D* CreateCapture();
+	void CreateCaptureSlot(FPortalCaptureSlot& Slot);
+	void UseCaptureSlot(FPortalCaptureSlot& Slot, float ResolutionScale, const FIntPoint& ViewSize, bool bStereo = false);
+	void SetSlotStereo(FPortalCaptureSlot& Slot, bool bStereo);
+	void ReleaseRenderTarget(FPortalCaptureSlot& Slot);
+	void ReleaseIdleRenderTargets();
+	void EvictRequesterSlots();
 
 	bool CheckNeedToUpdate(FVector ActorLocation) const;
+	bool IsPortalInSight(const USceneCaptureComponent2D* Capture, const APortal* VisiblePortal) const;
+	void IssueSightTrace(FPortalSightTrace& Trace) const;
+
+	// Reads the results of last frame's sight traces and issues them again, every frame so none of them get lost
+	void UpdateSightTraces();
+	void SetupCaptureClipping(USceneCaptureComponent2D* Capture) const;
+	float GetLastRenderTime() const;
+	bool IsCaptureActive() const;
+	void SweepCooldowns(float CurrentTime);
+	bool CanShareCapture(const FPortalPlayerView& Leader, const FPortalPlayerView& View) const;
+	int32 GroupPlayerViews();
+	FPortalCaptureSlot& GetGroupSlot(int32 Group);
+	void UpdatePlayerVisibility(int32 NumGroups);
+	void CaptureForGroup(int32 Group);
+	void CaptureForView(USceneCaptureComponent2D* Capture, FPortalHiddenSet* HiddenSet, const FTransform& CaptureTransform, float ResolutionScale, const FIntPoint& ViewSize, bool bRequired);
+	void OnPortalMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
 	void UpdateCapture();
 
+	// Points the navigation link at the Target's exit again, once either portal moved or the Target changed
+	void UpdateNavLink();
+
 	UFUNCTION()
 	void OnOverlapBegin(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult & SweepResult);
 
-	FTransform GetTeleportTransform(FTransform ActorTransform, bool bCaptureTransform = false) const;
+	const FPortalPairTransform& GetPairTransform() const;
+	static void TransformThroughPortal(const FPortalPairTransform& Pair, const FTransform* ActorTransforms, FTransform* OutTransforms, int32 Num, bool bCaptureTransform);
+
+	// Visibility traces of the captures looking out of this portal, by capture and seen portal IDs
+	mutable TMap<uint64, FPortalSightTrace> SightTraces;
+
+	// Scratch space of UpdatePortalsInSight by view depth, kept around to avoid reallocating every frame
+	mutable TIndirectArray<TArray<APortal*>> SightCandidates;
+
+	// Set when PortalMaterial has a TargetRight parameter to show the right eye's capture
+	bool bStereoMaterial = false;
+
+	// Bumped every time the portal moves
+	uint32 TransformVersion = 1;
+	mutable FPortalPairTransform PairTransform;
 
 	void Teleport(AActor* Actor);
 	void TeleportReceived(AActor* ReceivedActor);
+	void MoveThroughPortal(AActor* Actor, const FTransform& Transform);
+	bool ShouldTeleportLocally(const AActor* Actor) const;
+
+	// Sent by the server for replicated actors. The offset is where the actor came out, relative to the Target
+	UFUNCTION(NetMulticast, Reliable)
+	void MulticastTeleport(AActor* Actor, FVector_NetQuantize10 TargetOffset);
+
+	// Capture of the first group of local players, displayed on the Portal mesh
+	UPROPERTY()
+	FPortalCaptureSlot MainSlot;
+
+	// Captures of the other groups of splitscreen players, each with a mesh only its players see
+	UPROPERTY()
+	TArray<FPortalCaptureSlot> PlayerSlots;
+
+	// Local players looking at the portal this frame
+	TArray<FPortalPlayerView> PlayerViews;
+
+	friend class APortalManager;
+
+	// Plays the client side of a teleport without a session
+	friend class FPortalTeleportCorrectionTest;
+
+	// Captures of this portal made for views looking at it, by the ID of the requesting capture
+	UPROPERTY()
+	TMap<uint32, FPortalCaptureSlot> RequesterSlots;
+
+	// Seconds during which an actor which went through the portal can't be teleported back
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0.0"))
+	float TeleportCooldown = 0.1f;
+
+	FPortalCooldownTable TeleportedActors;
+	FPortalCooldownTable ReceivedActors;
 
-	void SetCleanupTimer(AActor* ActorToCleanup, TSet<AActor*>* ActorsList);
+	// Lets AI walk through the portal, from the entry location to the exit location
+	UPROPERTY(VisibleAnywhere, Category = "Portal")
+	UNavLinkCustomComponent* NavLink = nullptr;
 
-	TMap<uint32, USceneCaptureComponent2D*> CapturesMap;
-	TMap<uint32, UPrimitiveComponent*> PortalMeshesMap;
+	// Distance in front of the opening where the navigation link starts and ends
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0.0"))
+	float NavLinkOffset = 50.0f;
 
-	TSet<AActor*> TeleportedActors;
-	TSet<AActor*> ReceivedActors;
+	// Portals and versions the navigation link was last set up for
+	const APortal* NavLinkTarget = nullptr;
+	uint32 NavLinkSourceVersion = 0;
+	uint32 NavLinkTargetVersion = 0;
 
 	// Debug stuff
 	UPROPERTY(EditAnywhere, Category = "Portal")
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+class USceneCaptureComponent2D;
+
+// Decides which portal captures get rendered each frame.
+// Captures of portals which are small on screen and far away are only due every 2nd, 4th or 8th frame,
+// staggered so that they don't all land on the same frame. Due captures are requested during the portal ticks
+// and issued together once all actors have ticked, shallow ones first, until the per-frame budget runs out.
+// Captures left over keep their previous image, except required ones which are issued regardless of the budget.
+class PORTALACTOR_API FPortalCaptureScheduler {
+public:
+	static FPortalCaptureScheduler& Get();
+
+	// Whether a view at this depth may still get portals rendered inside it this frame
+	bool CanRecurse(int32 Depth) const;
+
+	// How many frames apart a capture should be rendered, from its share of the screen and distance to the viewer
+	int32 GetUpdateInterval(float ScreenScale, float Distance) const;
+
+	// Whether the capture is on its turn this frame
+	bool IsCaptureDue(const USceneCaptureComponent2D* Capture, float ScreenScale, float Distance) const;
+
+	// Queues the capture for this frame. It will only be rendered if the budget allows it, unless required,
+	// e.g. for a render target fresh from the pool which may still hold another portal's image
+	void RequestCapture(USceneCaptureComponent2D* Capture, int32 Depth, bool bRequired = false);
+
+	int32 GetCapturesThisFrame() const;
+
+	// Counts the game thread time of the scope against the frame's millisecond budget
+	struct FScopedWork {
+		FScopedWork();
+		~FScopedWork();
+	};
+
+private:
+	FPortalCaptureScheduler();
+
+	struct FRequest {
+		TWeakObjectPtr<USceneCaptureComponent2D> Capture;
+		int32 Depth;
+		uint64 Frame;
+		bool bRequired;
+	};
+
+	void BeginFrame();
+	double GetWorkSeconds() const;
+	void Flush(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	TArray<FRequest> Requests;
+	TArray<FRequest> Accepted;
+
+	uint64 Frame = 0;
+	int32 CapturesThisFrame = 0;
+	double WorkSeconds = 0.0;
+	double WorkStartTime = 0.0;
+};
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "GameFramework/CharacterMovementComponent.h"
+#include "PortalCharacterMovementComponent.generated.h"
+
+class APortal;
+
+// Character movement which tolerates the client and the server going through a portal a few moves apart.
+// The owning client teleports as soon as it crosses a portal, without waiting for the server. While the two
+// disagree, the server accepts client positions matching its own once mapped through a nearby portal,
+// instead of sending a correction across the level. When the client goes through, predicted or told by the
+// server, the moves it still waits on the server for are carried through the portal with it. A correction
+// the server sends for a move before the crossing is carried through as well, so the moves are replayed on
+// the side the character is on.
+UCLASS()
+class PORTALACTOR_API UPortalCharacterMovementComponent: public UCharacterMovementComponent {
+	GENERATED_BODY()
+
+public:
+	// Called whenever a portal moves the character, predicted or not
+	void NotifyTeleport(const APortal* Portal);
+
+	// Whether the character went through the portal within the last TeleportGraceTime seconds
+	bool HasRecentTeleport(const APortal* Portal) const;
+
+	uint32 GetNumTeleports() const { return NumTeleports; }
+	uint32 GetNumCorrections() const { return NumCorrections; }
+
+	// Client errors forgiven because they matched the other side of a portal
+	uint32 GetNumForgivenErrors() const { return NumForgivenErrors; }
+
+	// Server corrections from before a teleport, replayed from the other side of the portal
+	uint32 GetNumCarriedCorrections() const { return NumCarriedCorrections; }
+
+	virtual bool ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientLoc, const FVector& RelativeClientLoc, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
+	virtual void ClientAdjustPosition_Implementation(float TimeStamp, FVector NewLoc, FVector NewVel, UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase, bool bBaseRelativePosition, uint8 ServerMovementMode) override;
+
+protected:
+	virtual void ReplicateMoveToServer(float DeltaTime, const FVector& NewAcceleration) override;
+
+private:
+	// Seconds the client and the server may stay on different sides of a portal before the server corrects the client
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0.0"))
+	float TeleportGraceTime = 0.5f;
+
+	// How far apart the client and the server positions may be once mapped through the portal
+	UPROPERTY(EditAnywhere, Category = "Portal", meta = (ClampMin = "0.0"))
+	float TeleportErrorTolerance = 100.0f;
+
+	bool IsErrorThroughPortal(const FVector& ServerLoc, const FVector& ClientLoc);
+
+	// Moves the saved moves of the owning client to the other side of the portal
+	void TransformSavedMoves(const APortal* Portal);
+
+	// Whether the server location for the move at TimeStamp is from before the client went through the last portal
+	bool IsCorrectionBeforeTeleport(float TimeStamp, const FVector& ServerLoc) const;
+
+	TWeakObjectPtr<const APortal> LastTeleportPortal;
+	float LastTeleportTime = -1.0f;
+
+	// Set by a teleport of the owning client until the move it happened in is saved
+	bool bTeleportedThisMove = false;
+
+	// When the client and the server started disagreeing about the side of a portal, negative while they agree
+	float PortalErrorStartTime = -1.0f;
+
+	uint32 NumTeleports = 0;
+	uint32 NumCorrections = 0;
+	uint32 NumForgivenErrors = 0;
+	uint32 NumCarriedCorrections = 0;
+
+	// Scratch space for the portal queries, kept around to avoid reallocating every move
+	TArray<APortal*> NearbyPortals;
+};
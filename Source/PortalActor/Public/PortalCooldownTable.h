@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Actors which went through a portal recently and must not be teleported by it again yet.
+// Entries are kept in one flat array swept once per frame, with an index by actor so checks stay O(1)
+// however many projectiles go through at once.
+class PORTALACTOR_API FPortalCooldownTable {
+public:
+	// Starts or extends the cooldown of the actor
+	void Add(AActor* Actor, float ExpiryTime);
+	void Remove(const AActor* Actor);
+	bool Contains(const AActor* Actor) const;
+
+	// Drops expired entries and actors which no longer exist
+	void Sweep(float CurrentTime);
+
+private:
+	struct FEntry {
+		TWeakObjectPtr<AActor> Actor;
+		float ExpiryTime;
+	};
+
+	int32 Find(const AActor* Actor) const;
+	void RemoveAt(int32 Index);
+
+	TArray<FEntry, TInlineAllocator<16>> Entries;
+
+	// Index of each actor's entry. Weak keys, as a destroyed actor's address may be reused before the next sweep
+	TMap<TWeakObjectPtr<AActor>, int32> Indices;
+};
@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+class APortal;
+
+// Per-world graph of portals for route planning.
+// Nodes are portals, and an edge goes from every portal to every other one: the cost of walking from where
+// the first one lets out to the entrance of the second. Shortest costs between all pairs of portals are kept
+// precomputed, so a route query only has to pick the first and last portal instead of exploring the level.
+// Moving or retargeting a portal only recomputes the edges touching it. Edges getting cheaper are folded
+// into the existing costs, and edges getting more expensive only recompute the rows whose routes took them.
+// Edge costs outlive rebuilds, so adding or removing a portal only runs the pathfinds of its own edges.
+class PORTALACTOR_API FPortalGraph {
+public:
+	// Graph of the given world, created on first use
+	static FPortalGraph& Get(UWorld* World);
+
+	void Add(APortal* Portal);
+	void Remove(APortal* Portal);
+
+	// Marks the portal as moved or retargeted, the graph catches up on the next query
+	void Invalidate(APortal* Portal);
+
+	// Cheapest cost from going into one portal to going into the other, MAX_FLT if it can't be reached
+	float GetRouteCost(const APortal* From, const APortal* To);
+
+	// Cheapest way from Start to Goal, possibly through portals. Legs to the first and from the last portal
+	// are estimated as straight lines. OutPortals is empty when walking there directly is cheapest
+	float FindRoute(const FVector& Start, const FVector& Goal, TArray<APortal*>& OutPortals);
+
+	int32 Num() const;
+
+private:
+	explicit FPortalGraph(UWorld* InWorld);
+
+	void Update();
+	void Rebuild();
+	void GetChangedEdges(TArray<int32>& OutRows, TArray<int32>& OutColumns) const;
+	void FindAffectedRows(const TArray<bool>& IncreasedEdges, TArray<bool>& OutRows) const;
+	void ComputeRow(int32 From);
+	void RelaxEdge(int32 From, int32 To);
+	bool UpdateEdge(int32 From, int32 To);
+	float ComputeEdgeCost(int32 From, int32 To) const;
+
+	int32 GetIndex(int32 From, int32 To) const { return From * Nodes.Num() + To; }
+
+	TWeakObjectPtr<UWorld> World;
+
+	TArray<APortal*> Nodes;
+
+	// Direct edge costs, shortest costs and the first portal after From on the shortest route, all Nodes x Nodes
+	TArray<float> EdgeCosts;
+	TArray<float> Costs;
+	TArray<int32> Next;
+
+	// Nodes as they were when EdgeCosts was filled, to find the edges a rebuild can keep
+	TArray<APortal*> EdgeNodes;
+
+	TArray<APortal*> ChangedPortals;
+	bool bNeedsRebuild = false;
+
+	static TMap<TWeakObjectPtr<UWorld>, TSharedPtr<FPortalGraph>> Graphs;
+};
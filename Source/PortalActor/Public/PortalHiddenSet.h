@@ -0,0 +1,33 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+class USceneCaptureComponent2D;
+
+// Components a capture must not render, kept up to date incrementally.
+// The capture's HiddenComponents array is edited in place: every update pass marks the components still hidden,
+// and only the ones which were not marked get removed, so frames where nothing changes don't allocate.
+class PORTALACTOR_API FPortalHiddenSet {
+public:
+	explicit FPortalHiddenSet(USceneCaptureComponent2D* InCapture);
+
+	// Starts a pass, every component hidden during the pass stays hidden
+	void BeginUpdate();
+	void Hide(UPrimitiveComponent* Component);
+
+	// Unhides the components which were not hidden again since BeginUpdate
+	void EndUpdate();
+
+	int32 Num() const;
+
+private:
+	USceneCaptureComponent2D* Capture;
+
+	// Position of each component in the capture's HiddenComponents
+	TMap<const UPrimitiveComponent*, int32> Indices;
+
+	// Parallel to HiddenComponents: the component each entry was added for, and the pass which last hid it
+	TArray<const UPrimitiveComponent*> Components;
+	TArray<uint32> Passes;
+	uint32 Pass = 0;
+};
@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "GameFramework/Actor.h"
+#include "ConvexVolume.h"
+#include "Portal.h"
+#include "PortalManager.generated.h"
+
+// A local player's camera, as seen by every portal this frame
+struct FPortalCamera {
+	APlayerController* PlayerController;
+	FVector Location;
+	FTransform Transform;
+
+	// Eye transforms when in stereo
+	FTransform LeftEye;
+	FTransform RightEye;
+
+	FMatrix ViewProjection;
+	FConvexVolume Frustum;
+
+	// Size of a single eye's view in stereo
+	FIntPoint ViewSize;
+	bool bStereo;
+};
+
+// Updates all portals of a world at once, instead of every portal ticking on its own.
+// Per-portal state is gathered into flat arrays on the game thread, the view math of every portal and local player
+// pair runs in a ParallelFor, then the captures are set up on the game thread from the results.
+UCLASS(NotPlaceable, Transient)
+class PORTALACTOR_API APortalManager: public AActor {
+	GENERATED_BODY()
+
+public:
+	APortalManager();
+
+	// Manager of the world, spawned on first use
+	static APortalManager* Get(UWorld* World);
+
+	// Same as Get, without spawning one
+	static APortalManager* Find(UWorld* World);
+
+	void Register(APortal* Portal);
+	void Unregister(APortal* Portal);
+
+	// Lets every portal teleport the actor right away, e.g. when it gets reused for something else
+	void ClearCooldowns(const AActor* Actor);
+
+	const TArray<APortal*>& GetPortals() const { return Portals; }
+
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	FIntPoint GetViewportSize() const;
+	FIntPoint GetPlayerViewSize(const APlayerController* PlayerController) const;
+
+	void GatherCameras();
+	void GatherPortals();
+	bool ComputePlayerView(int32 PortalIndex, const FPortalCamera& Camera, FPortalPlayerView& OutView) const;
+
+	UPROPERTY()
+	TArray<APortal*> Portals;
+
+	// Per portal, in the same order as Portals
+	TArray<bool> ActivePortals;
+	TArray<FVector> Locations;
+	TArray<FVector> Forwards;
+	TArray<FBox> Bounds;
+	TArray<FPortalPairTransform> PairTransforms;
+
+	TArray<FPortalCamera> Cameras;
+
+	// Per portal and camera, all cameras of a portal next to each other
+	TArray<FPortalPlayerView> Views;
+	TArray<bool> VisibleViews;
+};
@@ -0,0 +1,40 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "ConvexVolume.h"
+
+class USceneCaptureComponent2D;
+
+// Shared view math for portal captures
+struct PORTALACTOR_API FPortalMath {
+	// World to view space, with the renderer's Z-forward axes
+	static FMatrix MakeViewMatrix(const FVector& ViewLocation, const FRotator& ViewRotation);
+
+	// Reversed Z perspective projection with an infinite far plane, like the one scene captures use
+	static FMatrix MakeProjectionMatrix(float FOVDegrees, float AspectRatio);
+
+	// View-projection matrix of a perspective view, in the same convention the renderer uses
+	static FMatrix MakeViewProjectionMatrix(const FVector& ViewLocation, const FRotator& ViewRotation, float FOVDegrees, float AspectRatio);
+
+	// Projection whose near plane is the given world space clip plane, so everything behind it gets clipped.
+	// Unlike the global clip plane, this costs nothing outside the capture using it
+	static FMatrix MakeObliqueProjectionMatrix(const FMatrix& ProjectionMatrix, const FMatrix& ViewMatrix, const FPlane& ClipPlane);
+
+	static float GetCaptureAspectRatio(const USceneCaptureComponent2D* Capture);
+
+	// View-projection matrix of the capture component at its current transform
+	static FMatrix MakeCaptureViewProjection(const USceneCaptureComponent2D* Capture);
+
+	// Frustum volume of what the capture component currently sees
+	static FConvexVolume MakeCaptureFrustum(const USceneCaptureComponent2D* Capture);
+
+	// Bounds of the capture frustum cut off at the given distance, as the frustum itself has no far plane
+	static FBox MakeCaptureFrustumBounds(const USceneCaptureComponent2D* Capture, float FarDistance);
+
+	// Whether any part of the bounds is inside the view frustum
+	static bool IsBoxInView(const FBox& Bounds, const FMatrix& ViewProjection);
+
+	// Fraction of the view covered by the projected bounds, from 0 to 1
+	static float GetScreenCoverage(const FBox& Bounds, const FMatrix& ViewProjection);
+};
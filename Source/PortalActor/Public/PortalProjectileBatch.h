@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "GameFramework/Actor.h"
+#include "Portal.h"
+#include "PortalProjectileBatch.generated.h"
+
+class APortalActorProjectile;
+class APortalManager;
+class UInstancedStaticMeshComponent;
+
+// Simulates many projectiles of one class without an actor each.
+// State lives in one array per component, so the integration runs four projectiles at a time. The collision
+// pass sweeps every projectile in a ParallelFor and tests its segment against the openings of all portals in
+// the same pass. Everything that changes the world, impulses and teleports, is then applied on the game thread.
+// All projectiles are drawn by a single instanced mesh.
+UCLASS(NotPlaceable, Transient)
+class PORTALACTOR_API APortalProjectileBatch: public AActor {
+	GENERATED_BODY()
+
+public:
+	APortalProjectileBatch();
+
+	// Batch of the world for the projectile class, spawned on first use. Movement and collision settings come from the class defaults
+	static APortalProjectileBatch* Get(UWorld* World, TSubclassOf<APortalActorProjectile> ProjectileClass);
+
+	void SetMesh(UStaticMesh* Mesh);
+
+	// Launches a projectile at the class' initial speed
+	void Fire(const FVector& Location, const FVector& Direction);
+
+	int32 Num() const;
+
+	virtual void BeginPlay() override;
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	struct FCollision {
+		FHitResult Hit;
+		bool bHit;
+
+		// Portal the projectile goes into before hitting anything, INDEX_NONE if none
+		int32 Portal;
+		float CrossingTime;
+	};
+
+	void Setup(TSubclassOf<APortalActorProjectile> InProjectileClass);
+	void Integrate(float DeltaTime);
+	void GatherPortals();
+	void Collide();
+	void Resolve();
+	void Bounce(int32 Index, const FHitResult& Hit, FVector& Velocity);
+	void Remove(int32 Index);
+	void UpdateInstances();
+
+	// Arrays are padded to a multiple of 4 for the vectorized integration
+	void Resize(int32 NewNum);
+
+	UPROPERTY()
+	UInstancedStaticMeshComponent* Instances = nullptr;
+
+	UPROPERTY()
+	TSubclassOf<APortalActorProjectile> ProjectileClass;
+
+	// Found once instead of every frame
+	TWeakObjectPtr<APortalManager> Manager;
+
+	// Copied from the projectile class
+	float Radius = 5.0f;
+	float InitialSpeed = 3000.0f;
+	float MaxSpeed = 3000.0f;
+	float GravityScale = 1.0f;
+	float Bounciness = 0.6f;
+	float Friction = 0.2f;
+	float LifeSpan = 3.0f;
+	bool bShouldBounce = true;
+	FName CollisionProfile;
+
+	// Slower than this after bouncing off the floor, a projectile stays where it is until it expires
+	float RestingSpeed = 5.0f;
+
+	int32 NumProjectiles = 0;
+
+	// Per projectile
+	TArray<float> PositionX;
+	TArray<float> PositionY;
+	TArray<float> PositionZ;
+	TArray<float> VelocityX;
+	TArray<float> VelocityY;
+	TArray<float> VelocityZ;
+
+	// Where the projectiles get to this frame without colliding
+	TArray<float> EndX;
+	TArray<float> EndY;
+	TArray<float> EndZ;
+
+	TArray<float> Ages;
+
+	// 1 while flying, 0 once resting
+	TArray<float> Moving;
+
+	TArray<FCollision> Collisions;
+
+	// Portals with a Target, gathered once per frame for the collision pass
+	TArray<APortal*> Portals;
+	TArray<FPortalOpening> Openings;
+
+	// What the instances were given last time, to leave the render state alone when nothing moved
+	TArray<FTransform> InstanceTransforms;
+};
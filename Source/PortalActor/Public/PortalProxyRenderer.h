@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "GameFramework/Actor.h"
+#include "PortalProxyRenderer.generated.h"
+
+class APortal;
+class UInstancedStaticMeshComponent;
+
+// Instances of one static mesh and set of materials, drawn for every actor using them
+USTRUCT()
+struct FPortalProxyBatch {
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UStaticMesh* Mesh = nullptr;
+
+	// By material slot
+	UPROPERTY()
+	TArray<UMaterialInterface*> Materials;
+
+	UPROPERTY()
+	UInstancedStaticMeshComponent* Instances = nullptr;
+
+	// Gathered during the update, written to the instances at the end of it
+	TArray<FTransform> Transforms;
+
+	// What the instances were given last time, to leave the render state alone when nothing moved
+	TArray<FTransform> LastTransforms;
+};
+
+// Draws the other half of actors going through a portal.
+// While an actor overlaps a portal's opening, its meshes are drawn again on the Target side through the pair transform.
+// Static meshes become instances of one shared instanced mesh per mesh and materials, so the cost doesn't grow with
+// the number of actors. Skeletal meshes get a proxy component following the source's pose as its master pose
+// component, without evaluating the animation a second time.
+UCLASS(NotPlaceable, Transient)
+class PORTALACTOR_API APortalProxyRenderer: public AActor {
+	GENERATED_BODY()
+
+public:
+	APortalProxyRenderer();
+
+	// Renderer of the world, spawned on first use
+	static APortalProxyRenderer* Get(UWorld* World);
+
+	// Same as Get, without spawning one
+	static APortalProxyRenderer* Find(UWorld* World);
+
+	void Register(APortal* Portal);
+	void Unregister(APortal* Portal);
+
+	virtual void Tick(float DeltaTime) override;
+
+private:
+	void AddStaticProxy(UStaticMeshComponent* Source, const FTransform& Transform);
+	void AddSkeletalProxy(USkeletalMeshComponent* Source, const FTransform& Transform);
+	void FlushStaticProxies();
+	void HideUnusedSkeletalProxies();
+
+	UPROPERTY()
+	TArray<APortal*> Portals;
+
+	UPROPERTY()
+	TArray<FPortalProxyBatch> Batches;
+
+	// Reused from frame to frame, the first NumSkeletalProxies are in use
+	UPROPERTY()
+	TArray<USkeletalMeshComponent*> SkeletalProxies;
+
+	int32 NumSkeletalProxies = 0;
+
+	// Scratch space, kept around to avoid reallocating every frame
+	TArray<AActor*> StraddlingActors;
+	TArray<UMaterialInterface*> SourceMaterials;
+};
@@ -0,0 +1,99 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "ConvexVolume.h"
+
+class APortal;
+
+// Per-world spatial index of portals.
+// Portals are bucketed into a uniform grid by their bounds, so visibility queries
+// only look at the portals whose cells overlap the query volume.
+// Also keeps track of fast moving actors, which could skip over a portal's overlap box between two frames.
+class PORTALACTOR_API FPortalRegistry {
+public:
+	// Edge length of a grid cell, in unreal units
+	static const float CellSize;
+
+	// Registry of the given world, created on first use
+	static FPortalRegistry& Get(const UWorld* World);
+
+	void Register(APortal* Portal);
+	void Unregister(APortal* Portal);
+
+	// Re-buckets a portal after it has been moved
+	void Update(APortal* Portal);
+
+	// Collects portals whose bounds intersect the volume. Only the cells overlapping VolumeBounds are looked at,
+	// so it must contain the part of the volume the query cares about
+	void QueryVolume(const FConvexVolume& Volume, const FBox& VolumeBounds, TArray<APortal*>& OutPortals) const;
+
+	// Collects portals whose bounds intersect the box, only looking at the cells within the registered portals' bounds
+	void QueryBox(const FBox& Box, TArray<APortal*>& OutPortals) const;
+
+	// Collects portals in the cells the segment passes through, walking only those cells instead of the segment's box
+	void QuerySegment(const FVector& Start, const FVector& End, TArray<APortal*>& OutPortals) const;
+
+	// Movers get teleported when the path they travelled since the previous frame crosses a portal
+	void AddMover(AActor* Actor);
+	void RemoveMover(AActor* Actor);
+
+	// Restarts the mover's path from where it is now, after it has been moved without travelling
+	void ResetMover(AActor* Actor);
+
+	// Checks the paths of all movers against the portals near them. Only runs once per frame
+	void UpdateMovers();
+
+	// Bounds of all registered portals
+	FBox GetBounds() const;
+
+	// Distance from the location to the furthest point a portal may be at
+	float GetMaxDistance(const FVector& Location) const;
+
+	int32 Num() const;
+
+private:
+	struct FEntry {
+		FBox Bounds;
+		FIntVector MinCell;
+		FIntVector MaxCell;
+		mutable uint32 QueryStamp = 0;
+	};
+
+	struct FMover {
+		TWeakObjectPtr<AActor> Actor;
+		FVector PreviousLocation;
+	};
+
+	struct FMoverPath {
+		AActor* Actor;
+		FVector Start;
+		FVector End;
+	};
+
+	FIntVector GetCell(const FVector& Location) const;
+	void ForEachCellInBounds(const FBox& QueryBounds, TFunctionRef<void(const FIntVector&, const TArray<APortal*>&)> Visit) const;
+	void AddToCells(APortal* Portal, const FEntry& Entry);
+	void RemoveFromCells(APortal* Portal, const FEntry& Entry);
+	void CollectCell(const FIntVector& CellKey, TArray<APortal*>& OutPortals) const;
+	void CollectCellInVolume(const FIntVector& CellKey, const TArray<APortal*>& Cell, const FConvexVolume& Volume, TArray<APortal*>& OutPortals) const;
+
+	TMap<APortal*, FEntry> Entries;
+	TMap<FIntVector, TArray<APortal*>> Cells;
+
+	// Used to report portals spanning several cells only once per query
+	mutable uint32 QueryCounter = 0;
+
+	// Refreshed on demand, as moved or removed portals may shrink it
+	mutable FBox Bounds = FBox(ForceInit);
+	mutable bool bBoundsDirty = false;
+
+	TArray<FMover> Movers;
+	uint64 LastMoversFrame = 0;
+
+	// Scratch space of UpdateMovers, kept around to avoid reallocating every frame
+	TArray<FMoverPath> MoverPaths;
+	TArray<APortal*> NearbyPortals;
+
+	static TMap<TWeakObjectPtr<const UWorld>, TSharedPtr<FPortalRegistry>> Registries;
+};
@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "UObject/GCObject.h"
+
+class UTextureRenderTarget2D;
+
+// Shared pool of render targets for portal scene captures.
+// Targets are handed out by size and format, and go back to the pool when a capture goes idle,
+// so portals whose captures are not needed in the same frame end up sharing GPU memory.
+class PORTALACTOR_API FPortalRenderTargetPool: public FGCObject {
+public:
+	static FPortalRenderTargetPool& Get();
+
+	// Frames a free target may stay unused before it is released for good
+	static const uint32 MaxFreeFrames;
+
+	UTextureRenderTarget2D* Acquire(int32 SizeX, int32 SizeY, EPixelFormat Format = PF_FloatRGBA);
+	void Release(UTextureRenderTarget2D* RenderTarget);
+
+	// Bytes held by the pool, both handed out and free
+	int64 GetLiveBytes() const { return LiveBytes; }
+	int64 GetPeakBytes() const { return PeakBytes; }
+	int64 GetInUseBytes() const { return InUseBytes; }
+	int32 GetNumTargets() const { return Targets.Num(); }
+
+	// FGCObject interface
+	virtual void AddReferencedObjects(FReferenceCollector& Collector) override;
+
+private:
+	struct FFreeTarget {
+		UTextureRenderTarget2D* RenderTarget;
+		uint64 ReleasedFrame;
+	};
+
+	struct FPoolKey {
+		int32 SizeX;
+		int32 SizeY;
+		EPixelFormat Format;
+
+		bool operator==(const FPoolKey& Other) const {
+			return SizeX == Other.SizeX && SizeY == Other.SizeY && Format == Other.Format;
+		}
+
+		friend uint32 GetTypeHash(const FPoolKey& Key) {
+			return HashCombine(HashCombine(GetTypeHash(Key.SizeX), GetTypeHash(Key.SizeY)), GetTypeHash((uint8)Key.Format));
+		}
+	};
+
+	static FPoolKey MakeKey(const UTextureRenderTarget2D* RenderTarget);
+	static int64 GetTargetBytes(const FPoolKey& Key);
+
+	// Frees targets which have not been asked for in a while
+	void Trim();
+
+	TArray<UTextureRenderTarget2D*> Targets;
+	TMap<FPoolKey, TArray<FFreeTarget>> FreeTargets;
+
+	int64 LiveBytes = 0;
+	int64 PeakBytes = 0;
+	int64 InUseBytes = 0;
+	uint64 LastTrimFrame = 0;
+};
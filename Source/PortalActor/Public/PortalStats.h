@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Stats/Stats.h"
+#include "Runtime/Launch/Resources/Version.h"
+
+// The CSV profiler only exists from 4.19 on, portal CSV stats compile to nothing before that
+#if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 19
+#include "ProfilingDebugging/CsvProfiler.h"
+#endif
+
+#if defined(CSV_PROFILER) && CSV_PROFILER
+#define PORTAL_CSV_PROFILER 1
+#else
+#define PORTAL_CSV_PROFILER 0
+#endif
+
+DECLARE_LOG_CATEGORY_EXTERN(LogPortal, Log, All);
+
+DECLARE_STATS_GROUP(TEXT("Portal"), STATGROUP_Portal, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Tick"), STAT_PortalTick, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("UpdateCapture"), STAT_PortalUpdateCapture, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("UpdatePortalsInSight"), STAT_PortalUpdatePortalsInSight, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("RenderForPortal"), STAT_PortalRenderForPortal, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Teleport"), STAT_PortalTeleport, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("UpdateMovers"), STAT_PortalUpdateMovers, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("GatherViews"), STAT_PortalGatherViews, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("FlushCaptures"), STAT_PortalFlushCaptures, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("UpdateGraph"), STAT_PortalUpdateGraph, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Trace"), STAT_PortalTrace, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("ProjectileBatch"), STAT_PortalProjectileBatch, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("UpdateProxies"), STAT_PortalUpdateProxies, STATGROUP_Portal, PORTALACTOR_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Captures rendered"), STAT_PortalCapturesRendered, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Captures over budget"), STAT_PortalCapturesOverBudget, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Captures not due"), STAT_PortalCapturesNotDue, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Visibility traces"), STAT_PortalTraces, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Hidden components"), STAT_PortalHiddenComponents, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Teleports"), STAT_PortalTeleports, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Trace hops"), STAT_PortalTraceHops, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Batched projectiles"), STAT_PortalBatchedProjectiles, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Proxies"), STAT_PortalProxies, STATGROUP_Portal, PORTALACTOR_API);
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pooled render targets"), STAT_PortalRenderTargets, STATGROUP_Portal, PORTALACTOR_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Pooled render target memory"), STAT_PortalRenderTargetMemory, STATGROUP_Portal, PORTALACTOR_API);
+
+// Stat group counters, also recorded in captured CSVs when the engine has the CSV profiler
+#if PORTAL_CSV_PROFILER
+CSV_DECLARE_CATEGORY_EXTERN(Portal);
+
+#define PORTAL_SCOPE_CYCLE_COUNTER(Name) \
+	SCOPE_CYCLE_COUNTER(STAT_Portal##Name); \
+	CSV_SCOPED_TIMING_STAT(Portal, Name)
+
+#define PORTAL_INC_COUNTER(Name, Amount) \
+	INC_DWORD_STAT_BY(STAT_Portal##Name, Amount); \
+	CSV_CUSTOM_STAT(Portal, Name, (int32)(Amount), ECsvCustomStatOp::Accumulate)
+
+#define PORTAL_SET_MEMORY(Name, Bytes) \
+	SET_MEMORY_STAT(STAT_Portal##Name, Bytes); \
+	CSV_CUSTOM_STAT(Portal, Name##MB, (float)((Bytes) / (1024.0 * 1024.0)), ECsvCustomStatOp::Set)
+#else
+#define PORTAL_SCOPE_CYCLE_COUNTER(Name) SCOPE_CYCLE_COUNTER(STAT_Portal##Name)
+#define PORTAL_INC_COUNTER(Name, Amount) INC_DWORD_STAT_BY(STAT_Portal##Name, Amount)
+#define PORTAL_SET_MEMORY(Name, Bytes) SET_MEMORY_STAT(STAT_Portal##Name, Bytes)
+#endif
+
+// Game thread timings of the portal entry points, read by the benchmark automation tests
+#define PORTAL_TIMINGS !UE_BUILD_SHIPPING
+
+enum class EPortalTiming: uint8 {
+	UpdateCapture,
+	UpdatePortalsInSight,
+	RenderForPortal,
+	Teleport,
+	Num
+};
+
+struct PORTALACTOR_API FPortalTimings {
+	// Inclusive time and number of outermost calls of an entry point since the last reset
+	static double GetMilliseconds(EPortalTiming Timing);
+	static uint32 GetCalls(EPortalTiming Timing);
+	static const TCHAR* GetName(EPortalTiming Timing);
+
+	static void Reset();
+
+private:
+	friend struct FPortalScopedTiming;
+
+	struct FEntry {
+		uint64 Cycles;
+		uint32 Calls;
+		int32 ScopeDepth;
+	};
+
+	static FEntry Entries[(int32)EPortalTiming::Num];
+};
+
+// Times the enclosing scope. Recursive calls are only counted once, by their outermost scope
+struct PORTALACTOR_API FPortalScopedTiming {
+	FPortalScopedTiming(EPortalTiming InTiming);
+	~FPortalScopedTiming();
+
+private:
+	EPortalTiming Timing;
+	uint32 StartCycles;
+};
+
+#if PORTAL_TIMINGS
+#define PORTAL_SCOPED_TIMING(Timing) FPortalScopedTiming PortalScopedTiming(EPortalTiming::Timing)
+#else
+#define PORTAL_SCOPED_TIMING(Timing)
+#endif
@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+class APortal;
+
+// Part of a trace between two portals
+struct FPortalTraceSegment {
+	FVector Start;
+	FVector End;
+
+	// Portal the segment went in through at its end, null for the last segment
+	const APortal* Portal;
+};
+
+struct FPortalTraceResult {
+	// Blocking hit at the end of the last segment
+	FHitResult Hit;
+	bool bBlockingHit = false;
+
+	// Set when the trace still went through a portal after its last allowed hop
+	bool bHopLimitReached = false;
+
+	TArray<FPortalTraceSegment, TInlineAllocator<4>> Segments;
+};
+
+struct FPortalTraceRequest {
+	FVector Start;
+	FVector End;
+};
+
+// Traces which carry on through the Target of the portals they go into, up to a number of hops.
+// The length left when going into a portal is kept on the other side.
+// Portals along each segment come from the registry cells it passes through, tested against their opening only.
+class PORTALACTOR_API FPortalTrace {
+public:
+	static bool LineTrace(UWorld* World, const FVector& Start, const FVector& End, ECollisionChannel Channel, const FCollisionQueryParams& Params, FPortalTraceResult& OutResult, int32 MaxHops = 4);
+
+	// The shape goes through a portal when its center does
+	static bool Sweep(UWorld* World, const FVector& Start, const FVector& End, const FQuat& Rotation, ECollisionChannel Channel, const FCollisionShape& Shape, const FCollisionQueryParams& Params, FPortalTraceResult& OutResult, int32 MaxHops = 4);
+
+	// Many traces sharing the same settings, e.g. for hitscan weapons or AI sight
+	static void LineTraces(UWorld* World, const TArray<FPortalTraceRequest>& Requests, ECollisionChannel Channel, const FCollisionQueryParams& Params, TArray<FPortalTraceResult>& OutResults, int32 MaxHops = 4);
+	static void Sweeps(UWorld* World, const TArray<FPortalTraceRequest>& Requests, const FQuat& Rotation, ECollisionChannel Channel, const FCollisionShape& Shape, const FCollisionQueryParams& Params, TArray<FPortalTraceResult>& OutResults, int32 MaxHops = 4);
+
+private:
+	static bool Trace(UWorld* World, const FVector& Start, const FVector& End, const FQuat& Rotation, ECollisionChannel Channel, const FCollisionShape& Shape, const FCollisionQueryParams& Params, FPortalTraceResult& OutResult, int32 MaxHops, TArray<APortal*>& NearbyPortals);
+};